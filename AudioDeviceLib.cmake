@@ -10,5 +10,14 @@ FetchContent_Declare(
 FetchContent_GetProperties(AudioDeviceLib)
 if(NOT audiodevicelib_POPULATED)
   FetchContent_Populate(AudioDeviceLib)
-  add_subdirectory("${audiodevicelib_SOURCE_DIR}" "${audiodevicelib_BINARY_DIR}" EXCLUDE_FROM_ALL)
+  if(WIN32 OR APPLE)
+    add_subdirectory("${audiodevicelib_SOURCE_DIR}" "${audiodevicelib_BINARY_DIR}" EXCLUDE_FROM_ALL)
+    # The Linux build has a separate headers target; there's only one backend
+    # here, so it's the whole library
+    add_library(AudioDeviceLibHeaders INTERFACE)
+    target_link_libraries(AudioDeviceLibHeaders INTERFACE AudioDeviceLib)
+  else()
+    # Upstream only has Windows and MacOS backends
+    add_subdirectory("${CMAKE_CURRENT_LIST_DIR}/LinuxAudioDeviceLib" "${CMAKE_BINARY_DIR}/LinuxAudioDeviceLib" EXCLUDE_FROM_ALL)
+  endif()
 endif()
@@ -0,0 +1,129 @@
+/* Copyright (c) 2018-present, Fred Emmott
+ *
+ * This source code is licensed under the MIT-style license found in the
+ * LICENSE file.
+ */
+#pragma once
+
+#include <AudioDevices/AudioDevices.h>
+#include <AudioDevices/SimulatedAudioDevices.h>
+#include <fmt/format.h>
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "ButtonRegistry.h"
+#include "audio_json.h"
+
+// Stops the compiler optimizing away a value that is otherwise unused
+template <class T>
+void KeepAlive(const T& value) {
+  asm volatile("" : : "g"(&value) : "memory");
+}
+
+// Calls `fn` repeatedly for at least `minDuration`, then prints the mean time
+// per call
+template <class F>
+void RunBenchmark(
+  std::string_view name,
+  F&& fn,
+  std::chrono::milliseconds minDuration = std::chrono::milliseconds(200)) {
+  using Clock = std::chrono::steady_clock;
+  // Warm up caches and allocators
+  fn();
+
+  uint64_t iterations = 0;
+  uint64_t batch = 1;
+  const auto start = Clock::now();
+  auto elapsed = Clock::duration::zero();
+  while (elapsed < minDuration) {
+    for (uint64_t i = 0; i < batch; ++i) {
+      fn();
+    }
+    iterations += batch;
+    batch *= 2;
+    elapsed = Clock::now() - start;
+  }
+
+  const auto nanoseconds
+    = std::chrono::duration<double, std::nano>(elapsed).count() / iterations;
+  fmt::print("{:<48} {:>12.1f} ns/op\n", name, nanoseconds);
+}
+
+constexpr std::array<std::pair<AudioDeviceDirection, AudioDeviceRole>, 4>
+  DIRECTIONS_AND_ROLES{{
+    {AudioDeviceDirection::OUTPUT, AudioDeviceRole::DEFAULT},
+    {AudioDeviceDirection::OUTPUT, AudioDeviceRole::COMMUNICATION},
+    {AudioDeviceDirection::INPUT, AudioDeviceRole::DEFAULT},
+    {AudioDeviceDirection::INPUT, AudioDeviceRole::COMMUNICATION},
+  }};
+
+// A connected device with a Windows-style ID; IDs sort in index order. The
+// interface names have the "N- " prefix Windows adds to duplicates, so
+// fuzzy matching has something to strip.
+inline AudioDeviceInfo MakeDevice(
+  size_t index,
+  AudioDeviceDirection direction = AudioDeviceDirection::OUTPUT) {
+  const auto interfaceName
+    = fmt::format("{}- USB Audio Device {}", index % 4 + 1, index);
+  const auto endpointName
+    = direction == AudioDeviceDirection::OUTPUT ? "Speakers" : "Microphone";
+  return {
+    .id = fmt::format(
+      "{{0.0.0.00000000}}.{{2b2c9b7e-3f1c-4a5d-9e62-{:012}}}", index),
+    .interfaceName = interfaceName,
+    .endpointName = endpointName,
+    .displayName = fmt::format("{} ({})", endpointName, interfaceName),
+    .direction = direction,
+    .state = AudioDeviceState::CONNECTED,
+  };
+}
+
+// `count` devices from MakeDevice(), keyed by ID
+inline std::map<std::string, AudioDeviceInfo> MakeDevices(
+  size_t count,
+  AudioDeviceDirection direction = AudioDeviceDirection::OUTPUT) {
+  std::map<std::string, AudioDeviceInfo> devices;
+  for (size_t i = 0; i < count; ++i) {
+    auto device = MakeDevice(i, direction);
+    devices.emplace(device.id, std::move(device));
+  }
+  return devices;
+}
+
+// Replaces the simulated backend's devices
+inline void SimulateDevices(
+  const std::map<std::string, AudioDeviceInfo>& devices) {
+  Simulated::LoadDeviceGraph("/dev/null");
+  for (const auto& [id, device] : devices) {
+    Simulated::AddDevice(device);
+  }
+}
+
+// A toggle button for the next of DIRECTIONS_AND_ROLES, with the raw JSON
+// settings the plugin would keep
+inline Button MakeButton(size_t index) {
+  const auto [direction, role]
+    = DIRECTIONS_AND_ROLES[index % DIRECTIONS_AND_ROLES.size()];
+  Button button;
+  button.action = "com.fredemmott.audiooutputswitch.toggle";
+  button.context = fmt::format("context-{:05}", index);
+  button.settings.direction = direction;
+  button.settings.role = role;
+  button.settings.primaryDevice = MakeDevice(2 * index, direction);
+  button.settings.secondaryDevice = MakeDevice(2 * index + 1, direction);
+  button.settings.InternDeviceIDs();
+  button.rawSettings = {
+    {"direction", direction},
+    {"role", role},
+    {"primary", button.settings.primaryDevice},
+    {"secondary", button.settings.secondaryDevice},
+  };
+  button.directionsAndRoles = {{direction, role}};
+  return button;
+}
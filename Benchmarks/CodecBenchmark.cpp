@@ -0,0 +1,132 @@
+/* Copyright (c) 2018-present, Fred Emmott
+ *
+ * This source code is licensed under the MIT-style license found in the
+ * LICENSE file.
+ */
+
+// Serializing 1000 devices, as a device map and as a cycle button's
+// settings: through nlohmann::json, with the streaming JSON writer into a
+// reused buffer, and with the binary codec. Also times reading each back.
+//
+// Then times loading the device cache file at startup with 1000 devices in
+// each direction, and how much of that is reading the file.
+//
+// Exits non-zero if the writer's output differs from nlohmann's.
+
+#include <nlohmann/json.hpp>
+
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <string>
+#include <string_view>
+
+#include "AudioDeviceCache.h"
+#include "audio_binary.h"
+#include "audio_json.h"
+#include "BenchmarkUtils.h"
+#include "ButtonSettings.h"
+
+using json = nlohmann::json;
+
+namespace {
+
+constexpr size_t DEVICE_COUNT = 1000;
+
+template <class T>
+bool BenchmarkCodecs(std::string_view what, const T& value) {
+  const auto name = [&](std::string_view how) {
+    return fmt::format("{} {}", how, what);
+  };
+
+  const auto text = json(value).dump();
+  std::string buffer;
+  AppendJSON(buffer, value);
+  if (buffer != text) {
+    fmt::print(stderr, "AppendJSON() differs from dump() for {}\n", what);
+    return false;
+  }
+
+  RunBenchmark(name("nlohmann dump"), [&]() {
+    KeepAlive(json(value).dump());
+  });
+  RunBenchmark(name("AppendJSON"), [&]() {
+    buffer.clear();
+    AppendJSON(buffer, value);
+    KeepAlive(buffer);
+  });
+  RunBenchmark(name("AppendBinary"), [&]() {
+    buffer.clear();
+    AppendBinary(buffer, value);
+    KeepAlive(buffer);
+  });
+
+  RunBenchmark(name("nlohmann parse"), [&]() {
+    KeepAlive(json::parse(text).get<T>());
+  });
+  buffer.clear();
+  AppendBinary(buffer, value);
+  T decoded;
+  RunBenchmark(name("ReadBinary"), [&]() {
+    std::string_view in{buffer};
+    KeepAlive(ReadBinary(in, decoded));
+  });
+  return true;
+}
+
+void BenchmarkLoad() {
+  auto devices = MakeDevices(DEVICE_COUNT);
+  for (size_t i = 0; i < DEVICE_COUNT; ++i) {
+    auto device = MakeDevice(DEVICE_COUNT + i, AudioDeviceDirection::INPUT);
+    devices.emplace(device.id, std::move(device));
+  }
+  SimulateDevices(devices);
+
+  const auto path = std::filesystem::temp_directory_path()
+    / fmt::format("CodecBenchmark-{}.bin", DEVICE_COUNT);
+  {
+    // With no scheduler, saves are done straight away
+    AudioDeviceCache cache;
+    cache.SetPersistentPath(path);
+    cache.Refresh(AudioDeviceDirection::OUTPUT);
+    cache.Refresh(AudioDeviceDirection::INPUT);
+  }
+
+  // As SetPersistentPath() does
+  const auto size = file_size(path);
+  RunBenchmark(fmt::format("Read {} byte cache file", size), [&]() {
+    std::string data(size, '\0');
+    std::ifstream f(path, std::ios::binary);
+    f.read(data.data(), data.size());
+    KeepAlive(data);
+  });
+  RunBenchmark("Load cache file", [&]() {
+    AudioDeviceCache cache;
+    KeepAlive(cache.SetPersistentPath(path));
+  });
+  std::filesystem::remove(path);
+}
+
+}// namespace
+
+int main() {
+  const auto devices = MakeDevices(DEVICE_COUNT);
+
+  ButtonSettings settings;
+  settings.direction = AudioDeviceDirection::OUTPUT;
+  settings.matchStrategy = DeviceMatchStrategy::Fuzzy;
+  for (const auto& [id, device] : devices) {
+    settings.cycleDevices.push_back(device);
+  }
+
+  const auto ok
+    = BenchmarkCodecs(fmt::format("{} devices", DEVICE_COUNT), devices)
+    && BenchmarkCodecs(
+        fmt::format("settings, {} devices", DEVICE_COUNT), settings);
+  if (!ok) {
+    return EXIT_FAILURE;
+  }
+  BenchmarkLoad();
+  return EXIT_SUCCESS;
+}
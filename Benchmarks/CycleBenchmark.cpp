@@ -0,0 +1,100 @@
+/* Copyright (c) 2018-present, Fred Emmott
+ *
+ * This source code is licensed under the MIT-style license found in the
+ * LICENSE file.
+ */
+
+// A 'cycle' press picks the device after the current one. CycleOrder keeps
+// the resolved order between presses, so this times a press with the order
+// resolved again - half the saved devices by fuzzy match, as after
+// replugging - and with it reused. Each press changes the default device, so
+// it also times the press after one, and what a device state notification
+// costs the order.
+
+#include <array>
+#include <string>
+
+#include "AudioDeviceCache.h"
+#include "BenchmarkUtils.h"
+#include "ButtonSettings.h"
+#include "CycleOrder.h"
+
+using namespace FredEmmott::Audio;
+
+namespace {
+
+// Every other device was saved under an ID that has since changed
+ButtonSettings MakeSettings(size_t count) {
+  ButtonSettings settings;
+  settings.direction = AudioDeviceDirection::OUTPUT;
+  settings.role = AudioDeviceRole::DEFAULT;
+  settings.matchStrategy = DeviceMatchStrategy::Fuzzy;
+  for (size_t i = 0; i < count; ++i) {
+    auto device = MakeDevice(i);
+    if (i % 2) {
+      device.id = fmt::format("unplugged-{:04}", i);
+      device.interfaceName = FuzzifyInterface(device.interfaceName);
+    }
+    settings.cycleDevices.push_back(device);
+  }
+  settings.InternDeviceIDs();
+  return settings;
+}
+
+}// namespace
+
+int main() {
+  for (const size_t count : {8, 64}) {
+    SimulateDevices(MakeDevices(count));
+    AudioDeviceCache cache;
+    const auto snapshot = cache.Get(AudioDeviceDirection::OUTPUT);
+    const auto settings = MakeSettings(count);
+    const size_t settingsHash = 1;
+    const auto current = InternDeviceID(MakeDevice(count / 2).id);
+
+    CycleOrder order;
+    order.Update(settings, settingsHash, *snapshot);
+
+    RunBenchmark(
+      fmt::format("Cycle through {}: resolve per press", count), [&]() {
+        KeepAlive(settings.VolatileCycleDevices(*snapshot));
+        KeepAlive(order.GetNext(current));
+      });
+
+    RunBenchmark(fmt::format("Cycle through {}: cached", count), [&]() {
+      order.Update(settings, settingsHash, *snapshot);
+      KeepAlive(order.GetNext(current));
+    });
+
+    // A press after a default change. Invalidating the cache made the press
+    // enumerate, then resolve the order again.
+    RunBenchmark(
+      fmt::format("Cycle through {}: after invalidating", count), [&]() {
+        cache.Invalidate(AudioDeviceDirection::OUTPUT);
+        const auto fresh = cache.Get(AudioDeviceDirection::OUTPUT);
+        order.Update(settings, settingsHash, *fresh);
+        KeepAlive(order.GetNext(current));
+      });
+    // The plugin now refreshes on its executor instead; a refresh that finds
+    // the same devices keeps the version, so the order is reused. Alternates
+    // between two refreshes, as pressing after each change would.
+    const std::array refreshed{
+      cache.Refresh(AudioDeviceDirection::OUTPUT),
+      cache.Refresh(AudioDeviceDirection::OUTPUT),
+    };
+    size_t press = 0;
+    RunBenchmark(
+      fmt::format("Cycle through {}: after refreshing", count), [&]() {
+        order.Update(settings, settingsHash, *refreshed[press++ % 2]);
+        KeepAlive(order.GetNext(current));
+      });
+
+    // What each device state notification costs each cycle button
+    bool connected = false;
+    RunBenchmark(fmt::format("Cycle through {}: state change", count), [&]() {
+      order.SetConnected(current, connected);
+      connected = !connected;
+    });
+  }
+  return 0;
+}
@@ -0,0 +1,85 @@
+/* Copyright (c) 2018-present, Fred Emmott
+ *
+ * This source code is licensed under the MIT-style license found in the
+ * LICENSE file.
+ */
+
+// What debug logging costs a key press. This times the plugin's key-up
+// handler for a toggle button with logging disabled, as in release builds,
+// and enabled. The handler logs the whole payload, and queues the switch;
+// the switch itself runs on another thread, so isn't included.
+//
+// While the log's ring buffer is full, messages are dropped before they're
+// formatted, so timing back-to-back presses would mostly time dropping
+// them. Instead, presses are timed in batches small enough to fit, with a
+// pause between batches for the buffer to be drained.
+//
+// Messages for Stream Deck are discarded.
+
+#include <nlohmann/json.hpp>
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "AudioSwitcherStreamDeckPlugin.h"
+#include "BenchmarkUtils.h"
+#include "DebugLog.h"
+#include "OutboundMessageQueue.h"
+
+namespace {
+
+// A key press logs a few messages, from the handler and the switch
+constexpr size_t PRESSES_PER_BATCH = 16;
+constexpr size_t BATCHES = 50;
+static_assert(PRESSES_PER_BATCH * 8 < DebugLog::CAPACITY);
+
+class DiscardingSink final : public OutboundMessageSink {
+ public:
+  void SetSettings(const std::string&, const nlohmann::json&) override {
+  }
+  void SetState(const std::string&, int) override {
+  }
+  void ShowAlert(const std::string&) override {
+  }
+};
+
+}// namespace
+
+int main() {
+  SimulateDevices(MakeDevices(2));
+  const auto button = MakeButton(0);
+  // As Stream Deck sends it
+  const nlohmann::json payload{
+    {"settings", button.rawSettings},
+    {"coordinates", {{"column", 0}, {"row", 0}}},
+    {"state", 0},
+    {"isInMultiAction", false},
+  };
+
+  AudioSwitcherStreamDeckPlugin plugin(std::make_unique<DiscardingSink>());
+  plugin.WillAppearForAction(button.action, button.context, payload, "device");
+
+  for (const auto enabled : {false, true}) {
+    DebugLog::SetEnabled(enabled);
+    std::chrono::steady_clock::duration elapsed{};
+    for (size_t batch = 0; batch < BATCHES; ++batch) {
+      std::this_thread::sleep_for(DebugLog::DRAIN_INTERVAL * 2);
+      const auto start = std::chrono::steady_clock::now();
+      for (size_t i = 0; i < PRESSES_PER_BATCH; ++i) {
+        plugin.KeyUpForAction(
+          button.action, button.context, payload, "device");
+      }
+      elapsed += std::chrono::steady_clock::now() - start;
+    }
+    const auto nanoseconds
+      = std::chrono::duration<double, std::nano>(elapsed).count()
+      / (BATCHES * PRESSES_PER_BATCH);
+    fmt::print(
+      "{:<48} {:>12.1f} ns/op\n",
+      fmt::format("Key up, debug logging {}", enabled ? "on" : "off"),
+      nanoseconds);
+  }
+  return 0;
+}
@@ -0,0 +1,152 @@
+/* Copyright (c) 2018-present, Fred Emmott
+ *
+ * This source code is licensed under the MIT-style license found in the
+ * LICENSE file.
+ */
+
+// Fanning out in both directions between buttons and devices.
+//
+// A default device change redraws the buttons that show that direction and
+// role. This times finding them by walking every button, and through the
+// registry's index, for 100 to 4000 buttons. It also times a Put() at each
+// size, with the index lists shared between snapshots and with the whole
+// index rebuilt.
+//
+// A 'set multiple devices' press changes up to four defaults. This times
+// making all four changes one after another, on a new thread each, and on a
+// FanOutPool, against the simulated backend with no delay and with a delay
+// more like a real endpoint switch.
+
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "BenchmarkUtils.h"
+#include "ButtonRegistry.h"
+#include "FanOutPool.h"
+
+using namespace FredEmmott::Audio;
+using namespace std::chrono_literals;
+
+namespace {
+
+void BenchmarkButtonFanOut() {
+  const std::pair changed{
+    AudioDeviceDirection::OUTPUT, AudioDeviceRole::DEFAULT};
+
+  for (const size_t count : {100, 1000, 4000}) {
+    ButtonRegistry registry;
+    for (size_t i = 0; i < count; ++i) {
+      registry.Put(MakeButton(i));
+    }
+    const auto snapshot = registry.Get();
+
+    RunBenchmark(fmt::format("Fan out to {} buttons: scan", count), [&]() {
+      for (const auto& [context, button] : snapshot->buttons) {
+        const auto& settings = button->settings;
+        if (
+          settings.direction == changed.first
+          && settings.role == changed.second) {
+          KeepAlive(button);
+        }
+      }
+    });
+
+    RunBenchmark(fmt::format("Fan out to {} buttons: index", count), [&]() {
+      const auto it = snapshot->buttonsByDirectionAndRole.find(changed);
+      if (it == snapshot->buttonsByDirectionAndRole.end()) {
+        return;
+      }
+      for (const auto& button : *it->second) {
+        KeepAlive(button);
+      }
+    });
+
+    // A change copies the snapshot, and the index lists it touches
+    const auto button = MakeButton(0);
+    RunBenchmark(fmt::format("Put with {} buttons", count), [&]() {
+      registry.Put(button);
+    });
+
+    // Rebuilding the whole index instead, for comparison
+    RunBenchmark(
+      fmt::format("Put with {} buttons, rebuilding the index", count), [&]() {
+        auto next = std::make_shared<ButtonRegistry::Snapshot>(*snapshot);
+        next->buttons.insert_or_assign(
+          button.context, std::make_shared<const Button>(button));
+        std::map<ButtonRegistry::DirectionAndRole, ButtonRegistry::Buttons>
+          index;
+        for (const auto& [context, it] : next->buttons) {
+          for (const auto& key : it->directionsAndRoles) {
+            index[key].push_back(it);
+          }
+        }
+        for (auto& [key, buttons] : index) {
+          next->buttonsByDirectionAndRole.insert_or_assign(
+            key, std::make_shared<ButtonRegistry::Buttons>(std::move(buttons)));
+        }
+        KeepAlive(next);
+      });
+  }
+}
+
+void BenchmarkSwitchFanOut() {
+  // Each run sets every default to the other device of the pair
+  const std::map<AudioDeviceDirection, std::pair<std::string, std::string>>
+    devices{
+      {AudioDeviceDirection::OUTPUT, {"sim-speakers", "sim-headset-out"}},
+      {AudioDeviceDirection::INPUT, {"sim-webcam", "sim-headset-in"}},
+    };
+  bool useFirst = true;
+  std::vector<std::function<void()>> switches;
+  for (const auto& [direction, role] : DIRECTIONS_AND_ROLES) {
+    switches.push_back([&, direction, role]() {
+      const auto& [first, second] = devices.at(direction);
+      SetDefaultAudioDeviceID(direction, role, useFirst ? first : second);
+    });
+  }
+
+  FanOutPool pool(switches.size() - 1);
+  for (const auto latency : {0us, 500us}) {
+    Simulated::SetLatency(latency);
+    const auto name = [&](const char* how) {
+      return fmt::format(
+        "Set 4 defaults, {}us each: {}", latency.count(), how);
+    };
+
+    RunBenchmark(name("one at a time"), [&]() {
+      for (const auto& function : switches) {
+        function();
+      }
+      useFirst = !useFirst;
+    });
+
+    RunBenchmark(name("thread each"), [&]() {
+      std::vector<std::thread> threads;
+      for (const auto& function : switches) {
+        threads.emplace_back(function);
+      }
+      for (auto& thread : threads) {
+        thread.join();
+      }
+      useFirst = !useFirst;
+    });
+
+    RunBenchmark(name("FanOutPool"), [&]() {
+      pool.Run(switches);
+      useFirst = !useFirst;
+    });
+  }
+  Simulated::SetLatency({});
+}
+
+}// namespace
+
+int main() {
+  BenchmarkButtonFanOut();
+  BenchmarkSwitchFanOut();
+  return 0;
+}
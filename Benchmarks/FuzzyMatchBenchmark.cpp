@@ -0,0 +1,86 @@
+/* Copyright (c) 2018-present, Fred Emmott
+ *
+ * This source code is licensed under the MIT-style license found in the
+ * LICENSE file.
+ */
+
+// Finding a replugged device: the same endpoint under a new ID and a
+// different "N- " interface prefix. Times stripping the prefix with
+// std::regex and with FuzzifyInterface(), then finding the match among 10 to
+// 1000 devices by scanning with each, and with the snapshot's index.
+
+#include <regex>
+#include <string>
+
+#include "AudioDeviceCache.h"
+#include "BenchmarkUtils.h"
+
+using namespace FredEmmott::Audio;
+
+namespace {
+
+std::string RegexFuzzifyInterface(const std::string& name) {
+  const std::regex pattern{"^([0-9]+- )?(.+)$"};
+  std::smatch captures;
+  if (!std::regex_match(name, captures, pattern)) {
+    return name;
+  }
+  return captures[2];
+}
+
+}// namespace
+
+int main() {
+  auto wanted = MakeDevice(0);
+  wanted.id = "unplugged";
+  wanted.interfaceName = "USB Headset";
+
+  const std::string interfaceName{"12- USB Headset"};
+  RunBenchmark("FuzzifyInterface: regex", [&]() {
+    KeepAlive(RegexFuzzifyInterface(interfaceName));
+  });
+  RunBenchmark("FuzzifyInterface: hand-written", [&]() {
+    KeepAlive(FuzzifyInterface(interfaceName));
+  });
+
+  for (const size_t count : {10, 100, 1000}) {
+    // Every device has the same endpoint name, so the interface names have
+    // to be compared; the only match is last
+    auto devices = MakeDevices(count);
+    devices.rbegin()->second.interfaceName = "2- " + wanted.interfaceName;
+
+    RunBenchmark(fmt::format("Find match in {}: regex scan", count), [&]() {
+      const auto fuzzyInterface = RegexFuzzifyInterface(wanted.interfaceName);
+      for (const auto& [id, device] : devices) {
+        if (
+          RegexFuzzifyInterface(device.interfaceName) == fuzzyInterface
+          && device.endpointName == wanted.endpointName) {
+          KeepAlive(id);
+          return;
+        }
+      }
+    });
+
+    RunBenchmark(
+      fmt::format("Find match in {}: hand-written scan", count), [&]() {
+        const auto fuzzyInterface = FuzzifyInterface(wanted.interfaceName);
+        for (const auto& [id, device] : devices) {
+          if (
+            device.endpointName == wanted.endpointName
+            && FuzzifyInterface(device.interfaceName) == fuzzyInterface) {
+            KeepAlive(id);
+            return;
+          }
+        }
+      });
+
+    // Built by the cache, as the plugin does
+    SimulateDevices(devices);
+    AudioDeviceCache cache;
+    const auto snapshot = cache.Get(AudioDeviceDirection::OUTPUT);
+    RunBenchmark(fmt::format("Find match in {}: snapshot index", count), [&]() {
+      KeepAlive(snapshot->FindFuzzyMatch(wanted));
+    });
+  }
+  return 0;
+}
@@ -0,0 +1,112 @@
+/* Copyright (c) 2018-present, Fred Emmott
+ *
+ * This source code is licensed under the MIT-style license found in the
+ * LICENSE file.
+ */
+
+// Hotkeys are compiled to key events when settings are parsed. This times a
+// trigger that looks the key name up first, one that compiles the whole
+// hotkey, and one that sends the compiled events, then a trigger's round
+// trip through HotkeyDispatcher's thread. Everything goes to a recording
+// sink, not the OS.
+
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "BenchmarkUtils.h"
+#include "ButtonSettings.h"
+#include "HotkeyDispatcher.h"
+#include "LatencyStats.h"
+
+namespace {
+
+// Windows virtual key codes
+constexpr uint16_t VK_SHIFT = 0x10;
+constexpr uint16_t VK_CONTROL = 0x11;
+constexpr uint16_t VK_F1 = 0x70;
+
+class RecordingSink final : public HotkeySink {
+ public:
+  void Send(const CompiledHotkey& hotkey) override {
+    {
+      std::scoped_lock lock(mMutex);
+      mLast = hotkey;
+      ++mCount;
+    }
+    mCV.notify_all();
+  }
+
+  uint64_t GetCount() {
+    std::scoped_lock lock(mMutex);
+    return mCount;
+  }
+
+  void WaitForCount(uint64_t count) {
+    std::unique_lock lock(mMutex);
+    mCV.wait(lock, [&]() { return mCount >= count; });
+  }
+
+ private:
+  std::mutex mMutex;
+  std::condition_variable mCV;
+  CompiledHotkey mLast;
+  uint64_t mCount = 0;
+};
+
+// The function key part of the key name lookup that used to run on every
+// trigger
+uint16_t ParseKeyCodePerTrigger(const std::string& keyCode) {
+  if (keyCode.substr(0, 1) == "F" && keyCode.length() <= 3) {
+    try {
+      const int fKey = std::stoi(keyCode.substr(1));
+      if (fKey >= 1 && fKey <= 24) {
+        return VK_F1 + (fKey - 1);
+      }
+    } catch (const std::exception&) {
+    }
+  }
+  return 0;
+}
+
+}// namespace
+
+int main() {
+  HotkeyConfig config;
+  config.enabled = true;
+  config.ctrl = true;
+  config.shift = true;
+  config.keyCode = "F13";
+  const auto compiled = CompileHotkey(config);
+
+  RecordingSink sink;
+  RunBenchmark("Trigger: parse key name, then send", [&]() {
+    CompiledHotkey hotkey;
+    const auto keyCode = ParseKeyCodePerTrigger(config.keyCode);
+    hotkey.events[hotkey.eventCount++] = {VK_CONTROL, true};
+    hotkey.events[hotkey.eventCount++] = {VK_SHIFT, true};
+    hotkey.events[hotkey.eventCount++] = {keyCode, true};
+    hotkey.events[hotkey.eventCount++] = {keyCode, false};
+    hotkey.events[hotkey.eventCount++] = {VK_SHIFT, false};
+    hotkey.events[hotkey.eventCount++] = {VK_CONTROL, false};
+    sink.Send(hotkey);
+  });
+  RunBenchmark("Trigger: compile, then send", [&]() {
+    sink.Send(CompileHotkey(config));
+  });
+  RunBenchmark("Trigger: send compiled", [&]() { sink.Send(compiled); });
+
+  LatencyStats stats;
+  auto ownedSink = std::make_unique<RecordingSink>();
+  auto& dispatched = *ownedSink;
+  HotkeyDispatcher dispatcher(std::move(ownedSink), stats);
+  RunBenchmark("Dispatch compiled and wait for send", [&]() {
+    const auto count = dispatched.GetCount();
+    dispatcher.Enqueue(compiled);
+    dispatched.WaitForCount(count + 1);
+  });
+  return 0;
+}
@@ -0,0 +1,170 @@
+/* Copyright (c) 2018-present, Fred Emmott
+ *
+ * This source code is licensed under the MIT-style license found in the
+ * LICENSE file.
+ */
+
+// Default device notifications read the buttons on the audio backend's
+// threads while Stream Deck events change them. This runs two reader threads
+// against one writer, and reports latency percentiles for each side, with
+// the buttons in a map behind a recursive mutex and in ButtonRegistry.
+
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "BenchmarkUtils.h"
+#include "ButtonRegistry.h"
+
+using namespace FredEmmott::Audio;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+constexpr size_t BUTTON_COUNT = 100;
+constexpr size_t CALLBACK_THREADS = 2;
+constexpr std::chrono::milliseconds DURATION{500};
+
+struct Percentiles {
+  size_t count = 0;
+  int64_t p50 = 0;
+  int64_t p99 = 0;
+  int64_t p999 = 0;
+  int64_t max = 0;
+};
+
+Percentiles GetPercentiles(std::vector<int64_t> samples) {
+  if (samples.empty()) {
+    return {};
+  }
+  std::sort(samples.begin(), samples.end());
+  const auto at = [&](double fraction) {
+    return samples[static_cast<size_t>(fraction * (samples.size() - 1))];
+  };
+  return {samples.size(), at(0.5), at(0.99), at(0.999), samples.back()};
+}
+
+void Print(std::string_view name, const Percentiles& p) {
+  fmt::print(
+    "{:<40} {:>9} ops  p50 {:>7}ns  p99 {:>8}ns  p99.9 {:>8}ns  max {:>9}ns\n",
+    name,
+    p.count,
+    p.p50,
+    p.p99,
+    p.p999,
+    p.max);
+}
+
+// Runs `read` on CALLBACK_THREADS threads and `write` on one, all for
+// DURATION, and prints the latency of each
+template <class Read, class Write>
+void Run(std::string_view name, Read&& read, Write&& write) {
+  std::atomic<bool> stopping{false};
+  std::vector<std::vector<int64_t>> readerSamples(CALLBACK_THREADS);
+  std::vector<int64_t> writerSamples;
+
+  const auto time = [](auto& fn, std::vector<int64_t>& samples) {
+    const auto start = Clock::now();
+    fn();
+    samples.push_back(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+        Clock::now() - start)
+        .count());
+  };
+
+  std::vector<std::thread> threads;
+  for (auto& samples : readerSamples) {
+    samples.reserve(1 << 20);
+    threads.emplace_back([&]() {
+      while (!stopping) {
+        time(read, samples);
+      }
+    });
+  }
+  writerSamples.reserve(1 << 20);
+  threads.emplace_back([&]() {
+    size_t i = 0;
+    while (!stopping) {
+      const auto update = [&]() { write(i++ % BUTTON_COUNT); };
+      time(update, writerSamples);
+    }
+  });
+
+  std::this_thread::sleep_for(DURATION);
+  stopping = true;
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  std::vector<int64_t> allReaderSamples;
+  for (const auto& samples : readerSamples) {
+    allReaderSamples.insert(
+      allReaderSamples.end(), samples.begin(), samples.end());
+  }
+  Print(fmt::format("{}: callback", name), GetPercentiles(allReaderSamples));
+  Print(fmt::format("{}: event", name), GetPercentiles(writerSamples));
+}
+
+}// namespace
+
+int main() {
+  std::vector<Button> buttons;
+  for (size_t i = 0; i < BUTTON_COUNT; ++i) {
+    buttons.push_back(MakeButton(i));
+  }
+  const auto changed = DIRECTIONS_AND_ROLES.front();
+
+  {
+    std::recursive_mutex mutex;
+    std::map<std::string, Button> locked;
+    for (const auto& button : buttons) {
+      locked.emplace(button.context, button);
+    }
+    Run(
+      "Recursive mutex",
+      [&]() {
+        std::scoped_lock lock(mutex);
+        for (const auto& [context, button] : locked) {
+          if (
+            button.settings.direction == changed.first
+            && button.settings.role == changed.second) {
+            KeepAlive(button);
+          }
+        }
+      },
+      [&](size_t index) {
+        std::scoped_lock lock(mutex);
+        locked.insert_or_assign(buttons[index].context, buttons[index]);
+      });
+  }
+
+  {
+    ButtonRegistry registry;
+    for (const auto& button : buttons) {
+      registry.Put(button);
+    }
+    Run(
+      "ButtonRegistry",
+      [&]() {
+        const auto snapshot = registry.Get();
+        const auto it = snapshot->buttonsByDirectionAndRole.find(changed);
+        if (it == snapshot->buttonsByDirectionAndRole.end()) {
+          return;
+        }
+        for (const auto& button : *it->second) {
+          KeepAlive(button);
+        }
+      },
+      [&](size_t index) { KeepAlive(registry.Put(buttons[index])); });
+  }
+  return 0;
+}
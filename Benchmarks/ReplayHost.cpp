@@ -0,0 +1,677 @@
+/* Copyright (c) 2018-present, Fred Emmott
+ *
+ * This source code is licensed under the MIT-style license found in the
+ * LICENSE file.
+ */
+
+// Stands in for the Stream Deck software: runs the plugin against the
+// simulated audio backend, replays recorded events to it over a websocket,
+// and reports how quickly they were handled.
+//
+// Usage: ReplayHost [options] trace.jsonl [trace.jsonl...]
+//
+//   --rate N          events per second; 0 (the default) sends each event as
+//                     soon as the previous one has been sent
+//   --repeat N        replay the traces N times
+//   --devices PATH    device graph for the simulated backend; see
+//                     SimulatedAudioDevices.h
+//   --latency-us N    delay added to every backend call
+//   --jitter-us N     random extra delay of up to N us per backend call
+//   --settle-ms N     wait this long after the last event before collecting
+//                     the plugin's own statistics (default 500)
+//
+// Each line of a trace is a JSON object, and is one of:
+//
+// - a Stream Deck event, sent to the plugin as-is, e.g.
+//   {"event": "keyDown", "action": "...", "context": "...", "payload": {...}}
+// - a change to the simulated devices, made by the host directly:
+//   {"simulator": "addDevice", "device": {...AudioDeviceInfo JSON...}}
+//   {"simulator": "removeDevice", "id": "..."}
+//   {"simulator": "setDeviceState", "id": "...", "state": "connected"}
+//   {"simulator": "setDefault", "direction": "output", "role": "default",
+//    "id": "..."}
+// - a pause: {"sleepMs": 100}
+//
+// Latency is measured from sending an event until the plugin's handler for
+// it returns, so it includes the websocket, the SDK's parsing, and any time
+// spent waiting behind earlier events.
+
+#include <AudioDevices/AudioDevices.h>
+#include <AudioDevices/SimulatedAudioDevices.h>
+#include <StreamDeckSDK/ESDMain.h>
+#include <fmt/format.h>
+#include <stdlib.h>
+#include <websocketpp/config/asio_no_tls.hpp>
+#include <websocketpp/server.hpp>
+
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "AudioSwitcherStreamDeckPlugin.h"
+#include "LatencyStats.h"
+#include "audio_json.h"
+
+using namespace FredEmmott::Audio;
+using json = nlohmann::json;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+using Server = websocketpp::server<websocketpp::config::asio>;
+
+constexpr std::string_view PLUGIN_UUID{"replay-host-plugin"};
+constexpr std::string_view REGISTER_EVENT{"registerPlugin"};
+// How long to wait for the plugin to connect, handle events, or reply
+constexpr std::chrono::seconds TIMEOUT{30};
+
+// Events that the SDK passes to a plugin handler, so they can be timed
+constexpr std::array<std::string_view, 9> TIMED_EVENTS{
+  "keyDown",
+  "keyUp",
+  "willAppear",
+  "willDisappear",
+  "deviceDidConnect",
+  "deviceDidDisconnect",
+  "sendToPlugin",
+  "didReceiveSettings",
+  "didReceiveGlobalSettings",
+};
+
+std::optional<size_t> GetTimedEventIndex(std::string_view event) {
+  const auto it = std::find(TIMED_EVENTS.begin(), TIMED_EVENTS.end(), event);
+  if (it == TIMED_EVENTS.end()) {
+    return {};
+  }
+  return it - TIMED_EVENTS.begin();
+}
+
+struct Options {
+  double rate = 0;
+  int repeat = 1;
+  std::string devices;
+  std::chrono::microseconds latency{0};
+  std::chrono::microseconds jitter{0};
+  std::chrono::milliseconds settle{500};
+  std::vector<std::string> traces;
+};
+
+// Pairs each sent event with its handler returning. The SDK calls handlers
+// in order on its one thread, so the next handler to return is always for
+// the oldest unhandled event.
+class EventTimings {
+ public:
+  void Sent(size_t eventIndex) {
+    std::scoped_lock lock(mMutex);
+    if (!mFirstSentAt) {
+      mFirstSentAt = Clock::now();
+    }
+    mInFlight.push_back({eventIndex, Clock::now()});
+  }
+
+  void Handled() {
+    const auto now = Clock::now();
+    {
+      std::scoped_lock lock(mMutex);
+      if (mInFlight.empty()) {
+        return;
+      }
+      const auto [eventIndex, sentAt] = mInFlight.front();
+      mInFlight.pop_front();
+      mHistograms[eventIndex].Record(
+        std::chrono::duration_cast<std::chrono::microseconds>(now - sentAt));
+      mLastHandledAt = now;
+    }
+    mCV.notify_all();
+  }
+
+  uint64_t GetHandledCount() const {
+    std::scoped_lock lock(mMutex);
+    uint64_t total = 0;
+    for (const auto& histogram : mHistograms) {
+      total += histogram.GetCount();
+    }
+    return total;
+  }
+
+  bool WaitForAll() {
+    std::unique_lock lock(mMutex);
+    return mCV.wait_for(lock, TIMEOUT, [this]() { return mInFlight.empty(); });
+  }
+
+  void Print() const {
+    std::scoped_lock lock(mMutex);
+    uint64_t total = 0;
+    for (const auto& histogram : mHistograms) {
+      total += histogram.GetCount();
+    }
+    if (total == 0 || !mFirstSentAt) {
+      fmt::print("No events replayed\n");
+      return;
+    }
+    const auto seconds
+      = std::chrono::duration<double>(mLastHandledAt - *mFirstSentAt).count();
+    fmt::print(
+      "Handled {} events in {:.3f}s: {:.1f} events/s\n\n",
+      total,
+      seconds,
+      seconds > 0 ? total / seconds : 0.0);
+
+    fmt::print(
+      "{:<26} {:>8} {:>10} {:>10} {:>10} {:>10}\n",
+      "event",
+      "count",
+      "p50 (us)",
+      "p90 (us)",
+      "p99 (us)",
+      "max (us)");
+    for (size_t i = 0; i < TIMED_EVENTS.size(); ++i) {
+      const auto& histogram = mHistograms[i];
+      if (histogram.GetCount() == 0) {
+        continue;
+      }
+      fmt::print(
+        "{:<26} {:>8} {:>10} {:>10} {:>10} {:>10}\n",
+        TIMED_EVENTS[i],
+        histogram.GetCount(),
+        histogram.GetValueAtPercentile(50),
+        histogram.GetValueAtPercentile(90),
+        histogram.GetValueAtPercentile(99),
+        histogram.GetMax());
+    }
+  }
+
+ private:
+  mutable std::mutex mMutex;
+  std::condition_variable mCV;
+  std::deque<std::pair<size_t, Clock::time_point>> mInFlight;
+  std::optional<Clock::time_point> mFirstSentAt;
+  Clock::time_point mLastHandledAt;
+  std::array<LatencyHistogram, TIMED_EVENTS.size()> mHistograms;
+};
+
+class TimedPlugin final : public AudioSwitcherStreamDeckPlugin {
+ public:
+  explicit TimedPlugin(EventTimings& timings) : mTimings(timings) {
+  }
+
+  void KeyDownForAction(
+    const std::string& inAction,
+    const std::string& inContext,
+    const json& inPayload,
+    const std::string& inDeviceID) override {
+    AudioSwitcherStreamDeckPlugin::KeyDownForAction(
+      inAction, inContext, inPayload, inDeviceID);
+    mTimings.Handled();
+  }
+
+  void KeyUpForAction(
+    const std::string& inAction,
+    const std::string& inContext,
+    const json& inPayload,
+    const std::string& inDeviceID) override {
+    AudioSwitcherStreamDeckPlugin::KeyUpForAction(
+      inAction, inContext, inPayload, inDeviceID);
+    mTimings.Handled();
+  }
+
+  void WillAppearForAction(
+    const std::string& inAction,
+    const std::string& inContext,
+    const json& inPayload,
+    const std::string& inDeviceID) override {
+    AudioSwitcherStreamDeckPlugin::WillAppearForAction(
+      inAction, inContext, inPayload, inDeviceID);
+    mTimings.Handled();
+  }
+
+  void WillDisappearForAction(
+    const std::string& inAction,
+    const std::string& inContext,
+    const json& inPayload,
+    const std::string& inDeviceID) override {
+    AudioSwitcherStreamDeckPlugin::WillDisappearForAction(
+      inAction, inContext, inPayload, inDeviceID);
+    mTimings.Handled();
+  }
+
+  void SendToPlugin(
+    const std::string& inAction,
+    const std::string& inContext,
+    const json& inPayload,
+    const std::string& inDeviceID) override {
+    AudioSwitcherStreamDeckPlugin::SendToPlugin(
+      inAction, inContext, inPayload, inDeviceID);
+    mTimings.Handled();
+  }
+
+  void DeviceDidConnect(const std::string& inDeviceID, const json& inDeviceInfo)
+    override {
+    AudioSwitcherStreamDeckPlugin::DeviceDidConnect(inDeviceID, inDeviceInfo);
+    mTimings.Handled();
+  }
+
+  void DeviceDidDisconnect(const std::string& inDeviceID) override {
+    AudioSwitcherStreamDeckPlugin::DeviceDidDisconnect(inDeviceID);
+    mTimings.Handled();
+  }
+
+  void DidReceiveGlobalSettings(const json& inPayload) override {
+    AudioSwitcherStreamDeckPlugin::DidReceiveGlobalSettings(inPayload);
+    mTimings.Handled();
+  }
+
+  void DidReceiveSettings(
+    const std::string& inAction,
+    const std::string& inContext,
+    const json& inPayload,
+    const std::string& inDeviceID) override {
+    AudioSwitcherStreamDeckPlugin::DidReceiveSettings(
+      inAction, inContext, inPayload, inDeviceID);
+    mTimings.Handled();
+  }
+
+ private:
+  EventTimings& mTimings;
+};
+
+// The Stream Deck end of the websocket
+class Host {
+ public:
+  Host() {
+    mServer.clear_access_channels(websocketpp::log::alevel::all);
+    mServer.clear_error_channels(websocketpp::log::elevel::all);
+    mServer.init_asio();
+    mServer.set_reuse_addr(true);
+    mServer.set_message_handler(
+      [this](websocketpp::connection_hdl connection, Server::message_ptr msg) {
+        OnMessage(connection, msg->get_payload());
+      });
+
+    namespace ip = websocketpp::lib::asio::ip;
+    // Port 0: let the OS pick a free one
+    mServer.listen(ip::tcp::endpoint(ip::address_v4::loopback(), 0));
+    websocketpp::lib::asio::error_code ec;
+    mPort = mServer.get_local_endpoint(ec).port();
+    mServer.start_accept();
+    mThread = std::thread([this]() { mServer.run(); });
+  }
+
+  ~Host() {
+    Close();
+    mThread.join();
+  }
+
+  uint16_t GetPort() const {
+    return mPort;
+  }
+
+  bool WaitForRegistration() {
+    std::unique_lock lock(mMutex);
+    return mCV.wait_for(
+      lock, TIMEOUT, [this]() { return mConnection.has_value(); });
+  }
+
+  void Send(const json& message) {
+    websocketpp::connection_hdl connection;
+    {
+      std::scoped_lock lock(mMutex);
+      connection = *mConnection;
+    }
+    websocketpp::lib::error_code ec;
+    mServer.send(
+      connection, message.dump(), websocketpp::frame::opcode::text, ec);
+    if (ec) {
+      fmt::print(stderr, "Failed to send event: {}\n", ec.message());
+    }
+  }
+
+  // The plugin's reply to a `getLatencyStats` request
+  std::optional<json> WaitForLatencyStats() {
+    std::unique_lock lock(mMutex);
+    mCV.wait_for(
+      lock, TIMEOUT, [this]() { return mLatencyStats.has_value(); });
+    return mLatencyStats;
+  }
+
+  // Messages from the plugin, by event
+  std::map<std::string, uint64_t> GetReceivedCounts() {
+    std::scoped_lock lock(mMutex);
+    return mReceivedCounts;
+  }
+
+  void Close() {
+    std::optional<websocketpp::connection_hdl> connection;
+    {
+      std::scoped_lock lock(mMutex);
+      if (mClosed) {
+        return;
+      }
+      mClosed = true;
+      connection = mConnection;
+    }
+    websocketpp::lib::error_code ec;
+    mServer.stop_listening(ec);
+    if (connection) {
+      mServer.close(*connection, websocketpp::close::status::normal, "", ec);
+    }
+  }
+
+ private:
+  Server mServer;
+  uint16_t mPort = 0;
+  std::thread mThread;
+
+  std::mutex mMutex;
+  std::condition_variable mCV;
+  std::optional<websocketpp::connection_hdl> mConnection;
+  bool mClosed = false;
+  std::map<std::string, uint64_t> mReceivedCounts;
+  std::optional<json> mLatencyStats;
+
+  void OnMessage(
+    websocketpp::connection_hdl connection,
+    const std::string& payload) {
+    const auto message = json::parse(payload, nullptr, false);
+    if (message.is_discarded() || !message.contains("event")) {
+      fmt::print(stderr, "Unexpected message from plugin: {}\n", payload);
+      return;
+    }
+    const auto event = message.at("event").get<std::string>();
+
+    {
+      std::scoped_lock lock(mMutex);
+      ++mReceivedCounts[event];
+      if (event == REGISTER_EVENT) {
+        if (message.value("uuid", "") != PLUGIN_UUID) {
+          fmt::print(stderr, "Registration has the wrong UUID: {}\n", payload);
+          return;
+        }
+        mConnection = connection;
+      } else if (
+        event == "sendToPropertyInspector"
+        && message.value("/payload/event"_json_pointer, "")
+          == "getLatencyStats") {
+        mLatencyStats = message.at("/payload/stats"_json_pointer);
+      } else {
+        return;
+      }
+    }
+    mCV.notify_all();
+  }
+};
+
+std::optional<Options> ParseOptions(int argc, char** argv) {
+  Options options;
+  for (int i = 1; i < argc; ++i) {
+    const std::string_view arg{argv[i]};
+    if (!arg.starts_with("--")) {
+      options.traces.push_back(argv[i]);
+      continue;
+    }
+    if (i + 1 >= argc) {
+      fmt::print(stderr, "{} needs a value\n", arg);
+      return {};
+    }
+    const char* value = argv[++i];
+    if (arg == "--rate") {
+      options.rate = std::atof(value);
+    } else if (arg == "--repeat") {
+      options.repeat = std::atoi(value);
+    } else if (arg == "--devices") {
+      options.devices = value;
+    } else if (arg == "--latency-us") {
+      options.latency = std::chrono::microseconds(std::atoll(value));
+    } else if (arg == "--jitter-us") {
+      options.jitter = std::chrono::microseconds(std::atoll(value));
+    } else if (arg == "--settle-ms") {
+      options.settle = std::chrono::milliseconds(std::atoll(value));
+    } else {
+      fmt::print(stderr, "Unknown option: {}\n", arg);
+      return {};
+    }
+  }
+  if (options.traces.empty()) {
+    fmt::print(stderr, "Usage: {} [options] trace.jsonl...\n", argv[0]);
+    return {};
+  }
+  return options;
+}
+
+std::optional<std::vector<json>> LoadTrace(const std::string& path) {
+  std::ifstream f(path);
+  if (!f) {
+    fmt::print(stderr, "Couldn't open {}\n", path);
+    return {};
+  }
+
+  std::vector<json> lines;
+  std::string line;
+  for (size_t lineNumber = 1; std::getline(f, line); ++lineNumber) {
+    if (line.empty()) {
+      continue;
+    }
+    auto parsed = json::parse(line, nullptr, false);
+    const bool valid = parsed.is_object()
+      && (parsed.contains("simulator") || parsed.contains("sleepMs")
+          || (parsed.contains("event")
+              && GetTimedEventIndex(parsed.value("event", ""))));
+    if (!valid) {
+      fmt::print(stderr, "{}:{}: unsupported trace line\n", path, lineNumber);
+      return {};
+    }
+    lines.push_back(std::move(parsed));
+  }
+  return lines;
+}
+
+void RunSimulatorCommand(const json& command) {
+  const auto name = command.at("simulator").get<std::string>();
+  if (name == "addDevice") {
+    Simulated::AddDevice(command.at("device").get<AudioDeviceInfo>());
+  } else if (name == "removeDevice") {
+    Simulated::RemoveDevice(command.at("id"));
+  } else if (name == "setDeviceState") {
+    Simulated::SetDeviceState(
+      command.at("id"), command.at("state").get<AudioDeviceState>());
+  } else if (name == "setDefault") {
+    SetDefaultAudioDeviceID(
+      command.at("direction").get<AudioDeviceDirection>(),
+      command.at("role").get<AudioDeviceRole>(),
+      command.at("id"));
+  } else {
+    fmt::print(stderr, "Unknown simulator command: {}\n", name);
+  }
+}
+
+// Calls made while replaying, rather than while starting up
+void PrintBackendCalls(
+  const Simulated::CallCounts& before,
+  const Simulated::CallCounts& after,
+  uint64_t events) {
+  fmt::print(
+    "\n{:<26} {:>8} {:>10}\n", "backend calls", "count", "per event");
+  const auto print = [events](std::string_view name, uint64_t count) {
+    fmt::print(
+      "{:<26} {:>8} {:>10.2f}\n",
+      name,
+      count,
+      events ? static_cast<double>(count) / events : 0.0);
+  };
+  print(
+    "GetAudioDeviceList",
+    after.getAudioDeviceList - before.getAudioDeviceList);
+  print(
+    "GetAudioDeviceState",
+    after.getAudioDeviceState - before.getAudioDeviceState);
+  print(
+    "GetDefaultAudioDeviceID",
+    after.getDefaultAudioDeviceID - before.getDefaultAudioDeviceID);
+  print(
+    "SetDefaultAudioDeviceID",
+    after.setDefaultAudioDeviceID - before.setDefaultAudioDeviceID);
+}
+
+void Replay(
+  const std::vector<json>& lines,
+  const Options& options,
+  Host& host,
+  EventTimings& timings) {
+  const auto interval = options.rate > 0
+    ? std::chrono::duration_cast<Clock::duration>(
+      std::chrono::duration<double>(1 / options.rate))
+    : Clock::duration::zero();
+  auto nextEventAt = Clock::now();
+
+  for (const auto& line : lines) {
+    if (line.contains("sleepMs")) {
+      std::this_thread::sleep_for(
+        std::chrono::milliseconds(line.at("sleepMs").get<int64_t>()));
+      nextEventAt = Clock::now();
+      continue;
+    }
+    if (line.contains("simulator")) {
+      RunSimulatorCommand(line);
+      continue;
+    }
+
+    std::this_thread::sleep_until(nextEventAt);
+    nextEventAt += interval;
+    timings.Sent(*GetTimedEventIndex(line.at("event").get<std::string>()));
+    host.Send(line);
+  }
+}
+
+}// namespace
+
+int main(int argc, char** argv) {
+  const auto options = ParseOptions(argc, argv);
+  if (!options) {
+    return EXIT_FAILURE;
+  }
+
+  std::vector<json> lines;
+  for (const auto& path : options->traces) {
+    auto trace = LoadTrace(path);
+    if (!trace) {
+      return EXIT_FAILURE;
+    }
+    lines.insert(lines.end(), trace->begin(), trace->end());
+  }
+
+  if (!options->devices.empty()) {
+    if (!Simulated::LoadDeviceGraph(options->devices)) {
+      fmt::print(stderr, "Couldn't load {}\n", options->devices);
+      return EXIT_FAILURE;
+    }
+  }
+  Simulated::SetLatency(options->latency, options->jitter);
+
+  // The plugin saves its device cache to the working directory; don't
+  // share it with other runs
+  std::string workingDirectory
+    = (std::filesystem::temp_directory_path() / "sdaudioswitch-replay-XXXXXX")
+        .string();
+  if (!mkdtemp(workingDirectory.data())) {
+    fmt::print(stderr, "Couldn't create a working directory\n");
+    return EXIT_FAILURE;
+  }
+  std::filesystem::current_path(workingDirectory);
+
+  Host host;
+  EventTimings timings;
+  // Like main(), the plugin is never destroyed
+  auto plugin = new TimedPlugin(timings);
+  const auto port = std::to_string(host.GetPort());
+  const json info{
+    {"application",
+     {{"language", "en"}, {"platform", "linux"}, {"version", "6.0.0"}}},
+    {"plugin", {{"uuid", PLUGIN_UUID}, {"version", "0.0.0"}}},
+    {"devicePixelRatio", 1},
+    {"devices", json::array()},
+  };
+  const auto infoString = info.dump();
+  std::thread pluginThread([&]() {
+    const std::array<const char*, 9> pluginArgs{
+      argv[0],
+      "-port",
+      port.c_str(),
+      "-pluginUUID",
+      PLUGIN_UUID.data(),
+      "-registerEvent",
+      REGISTER_EVENT.data(),
+      "-info",
+      infoString.c_str(),
+    };
+    esd_main(
+      static_cast<int>(pluginArgs.size()),
+      const_cast<const char**>(pluginArgs.data()),
+      plugin);
+  });
+
+  if (!host.WaitForRegistration()) {
+    fmt::print(stderr, "The plugin didn't register\n");
+    // Not returning, as the plugin thread is still running
+    std::exit(EXIT_FAILURE);
+  }
+
+  const auto callsBefore = Simulated::GetCallCounts();
+  for (int i = 0; i < options->repeat; ++i) {
+    Replay(lines, *options, host, timings);
+  }
+  if (!timings.WaitForAll()) {
+    fmt::print(stderr, "Timed out waiting for events to be handled\n");
+    std::exit(EXIT_FAILURE);
+  }
+  std::this_thread::sleep_for(options->settle);
+  const auto callsAfter = Simulated::GetCallCounts();
+
+  host.Send({
+    {"event", "sendToPlugin"},
+    {"action", "com.fredemmott.audiooutputswitch.set"},
+    {"context", "replay-host"},
+    {"payload", {{"event", "getLatencyStats"}}},
+  });
+  const auto pluginStats = host.WaitForLatencyStats();
+
+  timings.Print();
+  fmt::print("\n{:<26} {:>8}\n", "message from plugin", "count");
+  for (const auto& [event, count] : host.GetReceivedCounts()) {
+    fmt::print("{:<26} {:>8}\n", event, count);
+  }
+  PrintBackendCalls(callsBefore, callsAfter, timings.GetHandledCount());
+  if (pluginStats) {
+    fmt::print("\nPlugin statistics:\n{}\n", pluginStats->dump(2));
+  } else {
+    fmt::print(stderr, "The plugin didn't send its statistics\n");
+  }
+
+  host.Close();
+  pluginThread.join();
+
+  std::error_code ec;
+  std::filesystem::current_path(
+    std::filesystem::temp_directory_path(), ec);
+  std::filesystem::remove_all(workingDirectory, ec);
+
+  // The plugin's threads may still be working through queued switches, and
+  // would race with static destructors
+  std::fflush(stdout);
+  std::_Exit(pluginStats ? EXIT_SUCCESS : EXIT_FAILURE);
+}
@@ -0,0 +1,100 @@
+/* Copyright (c) 2018-present, Fred Emmott
+ *
+ * This source code is licensed under the MIT-style license found in the
+ * LICENSE file.
+ */
+
+// Stream Deck sends a button's settings with most events, but they rarely
+// change. This times parsing them into ButtonSettings against hashing and
+// comparing them with the last JSON seen, for each kind of button.
+
+#include <nlohmann/json.hpp>
+
+#include <functional>
+
+#include "BenchmarkUtils.h"
+#include "ButtonSettings.h"
+#include "audio_json.h"
+
+using namespace FredEmmott::Audio;
+using json = nlohmann::json;
+
+namespace {
+
+json MakeHotkey() {
+  return {
+    {"enabled", true},
+    {"ctrl", true},
+    {"alt", false},
+    {"shift", true},
+    {"win", false},
+    {"keyCode", "F13"},
+  };
+}
+
+json MakeToggleSettings() {
+  return {
+    {"direction", "output"},
+    {"role", "default"},
+    {"primary", MakeDevice(1, AudioDeviceDirection::OUTPUT)},
+    {"secondary", MakeDevice(2, AudioDeviceDirection::OUTPUT)},
+    {"matchStrategy", "Fuzzy"},
+    {"primaryHotkey", MakeHotkey()},
+    {"secondaryHotkey", MakeHotkey()},
+    {"hotkeysWaitForSwitch", false},
+  };
+}
+
+json MakeMultiSetSettings() {
+  auto targets = json::array();
+  for (const auto direction :
+       {AudioDeviceDirection::OUTPUT, AudioDeviceDirection::INPUT}) {
+    for (const auto role :
+         {AudioDeviceRole::DEFAULT, AudioDeviceRole::COMMUNICATION}) {
+      targets.push_back({
+        {"direction", direction},
+        {"role", role},
+        {"device", MakeDevice(targets.size(), direction)},
+      });
+    }
+  }
+  return {
+    {"direction", "output"},
+    {"targets", targets},
+  };
+}
+
+json MakeCycleSettings() {
+  auto devices = json::array();
+  for (size_t i = 0; i < 8; ++i) {
+    devices.push_back(MakeDevice(i, AudioDeviceDirection::OUTPUT));
+  }
+  return {
+    {"direction", "output"},
+    {"role", "default"},
+    {"cycleDevices", devices},
+  };
+}
+
+void Compare(std::string_view name, const json& settings) {
+  RunBenchmark(fmt::format("{}: parse", name), [&]() {
+    KeepAlive(settings.get<ButtonSettings>());
+  });
+
+  // What the plugin keeps from the last event
+  const json previous = settings;
+  const auto previousHash = std::hash<json>{}(previous);
+  RunBenchmark(fmt::format("{}: hash and compare", name), [&]() {
+    const auto hash = std::hash<json>{}(settings);
+    KeepAlive(hash == previousHash && settings == previous);
+  });
+}
+
+}// namespace
+
+int main() {
+  Compare("Toggle", MakeToggleSettings());
+  Compare("Set multiple", MakeMultiSetSettings());
+  Compare("Cycle through 8", MakeCycleSettings());
+  return 0;
+}
@@ -0,0 +1,714 @@
+/* Copyright (c) 2018-present, Fred Emmott
+ *
+ * This source code is licensed under the MIT-style license found in the
+ * LICENSE file.
+ */
+
+// AudioDevices.h backend for the PulseAudio API, which is also served by
+// PipeWire (pipewire-pulse).
+//
+// PulseAudio has a single default sink and default source, so both roles map
+// to them: setting either role sets the shared default, and a change is
+// reported for both roles. Devices are identified by their sink/source name;
+// monitor sources aren't listed.
+//
+// Sinks and sources being added, removed, or changing state are also
+// reported; see AudioDeviceChanges.h.
+
+#include <AudioDevices/AudioDeviceChanges.h>
+#include <AudioDevices/AudioDevices.h>
+#include <pulse/pulseaudio.h>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <list>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+namespace FredEmmott::Audio {
+
+using DefaultChangeCallback = std::function<
+  void(AudioDeviceDirection, AudioDeviceRole, const std::string&)>;
+
+namespace {
+
+struct DefaultChange {
+  AudioDeviceDirection direction;
+  AudioDeviceRole role;
+  std::string device;
+};
+
+struct DeviceChange {
+  std::string device;
+  AudioDeviceState state;
+};
+
+using Notification = std::variant<DefaultChange, DeviceChange>;
+
+std::string GetProperty(const pa_proplist* properties, const char* key) {
+  const auto value = pa_proplist_gets(properties, key);
+  return value ? value : std::string{};
+}
+
+// `Info` is pa_sink_info or pa_source_info
+template <class Info>
+AudioDeviceInfo MakeDeviceInfo(
+  const Info* info,
+  AudioDeviceDirection direction) {
+  AudioDeviceInfo ret;
+  ret.id = info->name;
+  ret.direction = direction;
+  ret.displayName = info->description ? info->description : info->name;
+
+  ret.interfaceName
+    = GetProperty(info->proplist, PA_PROP_DEVICE_PRODUCT_NAME);
+  if (ret.interfaceName.empty()) {
+    ret.interfaceName = GetProperty(info->proplist, "alsa.card_name");
+  }
+  if (ret.interfaceName.empty()) {
+    ret.interfaceName = ret.displayName;
+  }
+
+  ret.state = AudioDeviceState::CONNECTED;
+  if (info->active_port) {
+    ret.endpointName = info->active_port->description;
+    // e.g. nothing is plugged into a headphone jack
+    if (info->active_port->available == PA_PORT_AVAILABLE_NO) {
+      ret.state = AudioDeviceState::DEVICE_PRESENT_NO_CONNECTION;
+    }
+  } else {
+    ret.endpointName = ret.displayName;
+  }
+  return ret;
+}
+
+class PulseAudioBackend {
+ public:
+  static constexpr pa_usec_t RECONNECT_INTERVAL_USEC = PA_USEC_PER_SEC;
+
+  static PulseAudioBackend& Get() {
+    static PulseAudioBackend sInstance;
+    return sInstance;
+  }
+
+  ~PulseAudioBackend() {
+    {
+      std::scoped_lock lock(mNotificationsMutex);
+      mStopping = true;
+    }
+    mNotificationsCV.notify_all();
+    if (mDispatcher.joinable()) {
+      mDispatcher.join();
+    }
+
+    pa_threaded_mainloop_stop(mMainloop);
+    if (mContext) {
+      // Don't reconnect when we see PA_CONTEXT_TERMINATED
+      pa_context_set_state_callback(mContext, nullptr, nullptr);
+      pa_context_disconnect(mContext);
+      pa_context_unref(mContext);
+    }
+    pa_threaded_mainloop_free(mMainloop);
+  }
+
+  std::map<std::string, AudioDeviceInfo> GetDevices(
+    AudioDeviceDirection direction) {
+    struct Request {
+      PulseAudioBackend* backend;
+      std::map<std::string, AudioDeviceInfo> devices;
+    } request{this};
+
+    MainloopLock lock(mMainloop);
+    if (!WaitUntilReady()) {
+      return {};
+    }
+
+    if (direction == AudioDeviceDirection::OUTPUT) {
+      Wait(pa_context_get_sink_info_list(
+        mContext,
+        [](pa_context*, const pa_sink_info* info, int eol, void* userdata) {
+          auto request = static_cast<Request*>(userdata);
+          if (eol) {
+            request->backend->Signal();
+            return;
+          }
+          request->devices.emplace(
+            info->name, MakeDeviceInfo(info, AudioDeviceDirection::OUTPUT));
+        },
+        &request));
+    } else {
+      Wait(pa_context_get_source_info_list(
+        mContext,
+        [](pa_context*, const pa_source_info* info, int eol, void* userdata) {
+          auto request = static_cast<Request*>(userdata);
+          if (eol) {
+            request->backend->Signal();
+            return;
+          }
+          if (info->monitor_of_sink != PA_INVALID_INDEX) {
+            return;
+          }
+          request->devices.emplace(
+            info->name, MakeDeviceInfo(info, AudioDeviceDirection::INPUT));
+        },
+        &request));
+    }
+    return request.devices;
+  }
+
+  AudioDeviceState GetState(const std::string& id) {
+    struct Request {
+      PulseAudioBackend* backend;
+      std::optional<AudioDeviceState> state;
+    } request{this};
+
+    MainloopLock lock(mMainloop);
+    if (!WaitUntilReady()) {
+      return AudioDeviceState::DEVICE_NOT_PRESENT;
+    }
+
+    // Names are unique across sinks and sources
+    Wait(pa_context_get_sink_info_by_name(
+      mContext,
+      id.c_str(),
+      [](pa_context*, const pa_sink_info* info, int eol, void* userdata) {
+        auto request = static_cast<Request*>(userdata);
+        if (eol) {
+          request->backend->Signal();
+          return;
+        }
+        request->state
+          = MakeDeviceInfo(info, AudioDeviceDirection::OUTPUT).state;
+      },
+      &request));
+    if (request.state) {
+      return *request.state;
+    }
+    // Wait() unlocks the mainloop, so we may have been disconnected since
+    if (!WaitUntilReady()) {
+      return AudioDeviceState::DEVICE_NOT_PRESENT;
+    }
+
+    Wait(pa_context_get_source_info_by_name(
+      mContext,
+      id.c_str(),
+      [](pa_context*, const pa_source_info* info, int eol, void* userdata) {
+        auto request = static_cast<Request*>(userdata);
+        if (eol) {
+          request->backend->Signal();
+          return;
+        }
+        if (info->monitor_of_sink == PA_INVALID_INDEX) {
+          request->state
+            = MakeDeviceInfo(info, AudioDeviceDirection::INPUT).state;
+        }
+      },
+      &request));
+    return request.state.value_or(AudioDeviceState::DEVICE_NOT_PRESENT);
+  }
+
+  std::string GetDefault(AudioDeviceDirection direction) {
+    MainloopLock lock(mMainloop);
+    const auto [sink, source] = QueryDefaults();
+    return direction == AudioDeviceDirection::OUTPUT ? sink : source;
+  }
+
+  void SetDefault(AudioDeviceDirection direction, const std::string& id) {
+    MainloopLock lock(mMainloop);
+    if (!WaitUntilReady()) {
+      return;
+    }
+
+    const auto callback = [](pa_context*, int, void* userdata) {
+      static_cast<PulseAudioBackend*>(userdata)->Signal();
+    };
+    if (direction == AudioDeviceDirection::OUTPUT) {
+      Wait(pa_context_set_default_sink(mContext, id.c_str(), callback, this));
+    } else {
+      Wait(pa_context_set_default_source(mContext, id.c_str(), callback, this));
+    }
+  }
+
+  std::list<DefaultChangeCallback>::iterator AddCallback(
+    DefaultChangeCallback callback) {
+    std::scoped_lock lock(mCallbacksMutex);
+    return mCallbacks.insert(mCallbacks.end(), std::move(callback));
+  }
+
+  void RemoveCallback(std::list<DefaultChangeCallback>::iterator it) {
+    std::scoped_lock lock(mCallbacksMutex);
+    mCallbacks.erase(it);
+  }
+
+  std::list<DeviceChangeCallback>::iterator AddDeviceCallback(
+    DeviceChangeCallback callback) {
+    std::scoped_lock lock(mDeviceCallbacksMutex);
+    return mDeviceCallbacks.insert(mDeviceCallbacks.end(), std::move(callback));
+  }
+
+  void RemoveDeviceCallback(std::list<DeviceChangeCallback>::iterator it) {
+    std::scoped_lock lock(mDeviceCallbacksMutex);
+    mDeviceCallbacks.erase(it);
+  }
+
+ private:
+  class MainloopLock {
+   public:
+    explicit MainloopLock(pa_threaded_mainloop* mainloop)
+      : mMainloop(mainloop) {
+      pa_threaded_mainloop_lock(mMainloop);
+    }
+    ~MainloopLock() {
+      pa_threaded_mainloop_unlock(mMainloop);
+    }
+
+    MainloopLock(const MainloopLock&) = delete;
+    MainloopLock& operator=(const MainloopLock&) = delete;
+
+   private:
+    pa_threaded_mainloop* mMainloop;
+  };
+
+  pa_threaded_mainloop* mMainloop = nullptr;
+
+  // Guarded by the mainloop lock; null while waiting to reconnect
+  pa_context* mContext = nullptr;
+  // Only used on the mainloop thread. mHaveDefaults is false until we've
+  // first connected, so that isn't reported as a change.
+  bool mHaveDefaults = false;
+  std::string mDefaultSink;
+  std::string mDefaultSource;
+
+  // Sinks and sources by index, as removal events only have the index. Only
+  // used on the mainloop thread.
+  struct KnownDevice {
+    std::string id;
+    AudioDeviceState state;
+  };
+  std::map<uint32_t, KnownDevice> mSinks;
+  std::map<uint32_t, KnownDevice> mSources;
+
+  std::mutex mCallbacksMutex;
+  std::list<DefaultChangeCallback> mCallbacks;
+
+  std::mutex mDeviceCallbacksMutex;
+  std::list<DeviceChangeCallback> mDeviceCallbacks;
+
+  std::mutex mNotificationsMutex;
+  std::condition_variable mNotificationsCV;
+  std::deque<Notification> mNotifications;
+  bool mStopping = false;
+  std::thread mDispatcher;
+
+  PulseAudioBackend() {
+    mMainloop = pa_threaded_mainloop_new();
+    // Doesn't need the lock as the mainloop isn't running yet
+    StartConnecting();
+    pa_threaded_mainloop_start(mMainloop);
+    mDispatcher = std::thread([this]() { DispatchNotifications(); });
+  }
+
+  void Signal() {
+    pa_threaded_mainloop_signal(mMainloop, 0);
+  }
+
+  // Requires the mainloop lock; can't be called from the mainloop thread.
+  // Unlocks the mainloop while waiting, so the context may have been
+  // disconnected - and mContext replaced - by the time this returns; call
+  // WaitUntilReady() again before using it.
+  void Wait(pa_operation* operation) {
+    if (!operation) {
+      return;
+    }
+    while (pa_operation_get_state(operation) == PA_OPERATION_RUNNING) {
+      pa_threaded_mainloop_wait(mMainloop);
+    }
+    pa_operation_unref(operation);
+  }
+
+  // Requires the mainloop lock; false if not connected to the server
+  bool WaitUntilReady() {
+    while (mContext) {
+      const auto state = pa_context_get_state(mContext);
+      if (state == PA_CONTEXT_READY) {
+        return true;
+      }
+      if (!PA_CONTEXT_IS_GOOD(state)) {
+        return false;
+      }
+      pa_threaded_mainloop_wait(mMainloop);
+    }
+    return false;
+  }
+
+  // Called on the mainloop thread, except from the constructor
+  void StartConnecting() {
+    mContext = pa_context_new(
+      pa_threaded_mainloop_get_api(mMainloop), "StreamDeck-AudioSwitcher");
+    pa_context_set_state_callback(
+      mContext,
+      [](pa_context*, void* userdata) {
+        static_cast<PulseAudioBackend*>(userdata)->OnContextStateChanged();
+      },
+      this);
+    const auto result
+      = pa_context_connect(mContext, nullptr, PA_CONTEXT_NOFLAGS, nullptr);
+    if (result < 0) {
+      pa_context_set_state_callback(mContext, nullptr, nullptr);
+      pa_context_unref(mContext);
+      mContext = nullptr;
+      ScheduleReconnect();
+    }
+  }
+
+  // Called on the mainloop thread
+  void OnContextStateChanged() {
+    switch (pa_context_get_state(mContext)) {
+      case PA_CONTEXT_READY:
+        pa_context_set_subscribe_callback(
+          mContext,
+          [](
+            pa_context*,
+            pa_subscription_event_type_t type,
+            uint32_t index,
+            void* userdata) {
+            static_cast<PulseAudioBackend*>(userdata)->OnSubscriptionEvent(
+              type, index);
+          },
+          this);
+        pa_operation_unref(pa_context_subscribe(
+          mContext,
+          static_cast<pa_subscription_mask_t>(
+            PA_SUBSCRIPTION_MASK_SERVER | PA_SUBSCRIPTION_MASK_SINK
+            | PA_SUBSCRIPTION_MASK_SOURCE),
+          nullptr,
+          nullptr));
+        // Get the current defaults, and report any change while we were
+        // disconnected
+        OnServerChanged();
+        OnConnected();
+        break;
+      case PA_CONTEXT_FAILED:
+      case PA_CONTEXT_TERMINATED:
+        // e.g. the server was restarted
+        pa_context_set_state_callback(mContext, nullptr, nullptr);
+        pa_context_unref(mContext);
+        mContext = nullptr;
+        ScheduleReconnect();
+        break;
+      default:
+        break;
+    }
+    // Wake up anything in WaitUntilReady() or Wait()
+    Signal();
+  }
+
+  // Called on the mainloop thread
+  void ScheduleReconnect() {
+    timeval when;
+    pa_gettimeofday(&when);
+    pa_timeval_add(&when, RECONNECT_INTERVAL_USEC);
+    const auto api = pa_threaded_mainloop_get_api(mMainloop);
+    api->time_new(
+      api,
+      &when,
+      [](pa_mainloop_api* api, pa_time_event* event, const timeval*, void* u) {
+        api->time_free(event);
+        static_cast<PulseAudioBackend*>(u)->StartConnecting();
+      },
+      this);
+  }
+
+  // Requires the mainloop lock; returns the default sink and source, or
+  // empty strings if not connected
+  std::pair<std::string, std::string> QueryDefaults() {
+    struct Request {
+      PulseAudioBackend* backend;
+      std::string sink;
+      std::string source;
+    } request{this};
+    // Callers may have waited for something else since checking
+    if (!WaitUntilReady()) {
+      return {};
+    }
+    Wait(pa_context_get_server_info(
+      mContext,
+      [](pa_context*, const pa_server_info* info, void* userdata) {
+        auto request = static_cast<Request*>(userdata);
+        if (info) {
+          if (info->default_sink_name) {
+            request->sink = info->default_sink_name;
+          }
+          if (info->default_source_name) {
+            request->source = info->default_source_name;
+          }
+        }
+        request->backend->Signal();
+      },
+      &request));
+    return {request.sink, request.source};
+  }
+
+  // Called on the mainloop thread
+  void OnSubscriptionEvent(pa_subscription_event_type_t type, uint32_t index) {
+    const auto facility = type & PA_SUBSCRIPTION_EVENT_FACILITY_MASK;
+    if (facility == PA_SUBSCRIPTION_EVENT_SERVER) {
+      OnServerChanged();
+      return;
+    }
+    if (
+      facility != PA_SUBSCRIPTION_EVENT_SINK
+      && facility != PA_SUBSCRIPTION_EVENT_SOURCE) {
+      return;
+    }
+
+    const auto kind = type & PA_SUBSCRIPTION_EVENT_TYPE_MASK;
+    if (kind == PA_SUBSCRIPTION_EVENT_REMOVE) {
+      auto& known
+        = (facility == PA_SUBSCRIPTION_EVENT_SINK) ? mSinks : mSources;
+      const auto it = known.find(index);
+      // Not found if it's a monitor source
+      if (it != known.end()) {
+        NotifyDeviceChanged(
+          it->second.id, AudioDeviceState::DEVICE_NOT_PRESENT);
+        known.erase(it);
+      }
+      return;
+    }
+
+    // Added or changed; we're told about every volume change too, so this
+    // only reports the device if its state is different
+    if (facility == PA_SUBSCRIPTION_EVENT_SINK) {
+      pa_operation_unref(pa_context_get_sink_info_by_index(
+        mContext,
+        index,
+        [](pa_context*, const pa_sink_info* info, int eol, void* userdata) {
+          if (!eol) {
+            static_cast<PulseAudioBackend*>(userdata)->OnDeviceInfo(
+              info, AudioDeviceDirection::OUTPUT, true);
+          }
+        },
+        this));
+    } else {
+      pa_operation_unref(pa_context_get_source_info_by_index(
+        mContext,
+        index,
+        [](pa_context*, const pa_source_info* info, int eol, void* userdata) {
+          if (!eol) {
+            static_cast<PulseAudioBackend*>(userdata)->OnDeviceInfo(
+              info, AudioDeviceDirection::INPUT, true);
+          }
+        },
+        this));
+    }
+  }
+
+  // Called on the mainloop thread. Lists the current devices so that later
+  // removals can be identified, and reports that anything may have changed
+  // while we were disconnected.
+  void OnConnected() {
+    mSinks.clear();
+    mSources.clear();
+    pa_operation_unref(pa_context_get_sink_info_list(
+      mContext,
+      [](pa_context*, const pa_sink_info* info, int eol, void* userdata) {
+        if (!eol) {
+          static_cast<PulseAudioBackend*>(userdata)->OnDeviceInfo(
+            info, AudioDeviceDirection::OUTPUT, false);
+        }
+      },
+      this));
+    pa_operation_unref(pa_context_get_source_info_list(
+      mContext,
+      [](pa_context*, const pa_source_info* info, int eol, void* userdata) {
+        if (!eol) {
+          static_cast<PulseAudioBackend*>(userdata)->OnDeviceInfo(
+            info, AudioDeviceDirection::INPUT, false);
+        }
+      },
+      this));
+    NotifyDeviceChanged({}, AudioDeviceState::DEVICE_NOT_PRESENT);
+  }
+
+  // Called on the mainloop thread. `Info` is pa_sink_info or pa_source_info.
+  template <class Info>
+  void OnDeviceInfo(
+    const Info* info,
+    AudioDeviceDirection direction,
+    bool notify) {
+    if constexpr (std::is_same_v<Info, pa_source_info>) {
+      if (info->monitor_of_sink != PA_INVALID_INDEX) {
+        return;
+      }
+    }
+    auto& known
+      = (direction == AudioDeviceDirection::OUTPUT) ? mSinks : mSources;
+    const auto state = MakeDeviceInfo(info, direction).state;
+    const auto [it, added]
+      = known.try_emplace(info->index, KnownDevice{info->name, state});
+    if (!added) {
+      if (it->second.state == state) {
+        return;
+      }
+      it->second.state = state;
+    }
+    if (notify) {
+      NotifyDeviceChanged(info->name, state);
+    }
+  }
+
+  // Called on the mainloop thread, so can't wait for anything
+  void OnServerChanged() {
+    pa_operation_unref(pa_context_get_server_info(
+      mContext,
+      [](pa_context*, const pa_server_info* info, void* userdata) {
+        if (!info) {
+          return;
+        }
+        auto backend = static_cast<PulseAudioBackend*>(userdata);
+        backend->OnDefaultsChanged(
+          info->default_sink_name ? info->default_sink_name : "",
+          info->default_source_name ? info->default_source_name : "");
+      },
+      this));
+  }
+
+  // Called on the mainloop thread
+  void OnDefaultsChanged(const std::string& sink, const std::string& source) {
+    if (!mHaveDefaults) {
+      mHaveDefaults = true;
+      mDefaultSink = sink;
+      mDefaultSource = source;
+      return;
+    }
+    if (sink != mDefaultSink) {
+      mDefaultSink = sink;
+      NotifyAllRoles(AudioDeviceDirection::OUTPUT, sink);
+    }
+    if (source != mDefaultSource) {
+      mDefaultSource = source;
+      NotifyAllRoles(AudioDeviceDirection::INPUT, source);
+    }
+  }
+
+  void NotifyAllRoles(AudioDeviceDirection direction, const std::string& id) {
+    {
+      std::scoped_lock lock(mNotificationsMutex);
+      for (const auto role :
+           {AudioDeviceRole::DEFAULT, AudioDeviceRole::COMMUNICATION}) {
+        mNotifications.push_back(DefaultChange{direction, role, id});
+      }
+    }
+    mNotificationsCV.notify_one();
+  }
+
+  void NotifyDeviceChanged(const std::string& id, AudioDeviceState state) {
+    {
+      std::scoped_lock lock(mNotificationsMutex);
+      mNotifications.push_back(DeviceChange{id, state});
+    }
+    mNotificationsCV.notify_one();
+  }
+
+  // Callbacks aren't invoked on the mainloop thread, so they can call back
+  // into the backend
+  void DispatchNotifications() {
+    while (true) {
+      Notification notification;
+      {
+        std::unique_lock lock(mNotificationsMutex);
+        mNotificationsCV.wait(
+          lock, [this]() { return mStopping || !mNotifications.empty(); });
+        if (mStopping) {
+          return;
+        }
+        notification = std::move(mNotifications.front());
+        mNotifications.pop_front();
+      }
+
+      if (const auto change = std::get_if<DefaultChange>(&notification)) {
+        std::scoped_lock lock(mCallbacksMutex);
+        for (const auto& callback : mCallbacks) {
+          callback(change->direction, change->role, change->device);
+        }
+        continue;
+      }
+
+      const auto& change = std::get<DeviceChange>(notification);
+      std::scoped_lock lock(mDeviceCallbacksMutex);
+      for (const auto& callback : mDeviceCallbacks) {
+        callback(change.device, change.state);
+      }
+    }
+  }
+};
+
+}// namespace
+
+struct DefaultChangeCallbackHandleImpl {
+  std::list<DefaultChangeCallback>::iterator mIterator;
+
+  explicit DefaultChangeCallbackHandleImpl(DefaultChangeCallback callback)
+    : mIterator(PulseAudioBackend::Get().AddCallback(std::move(callback))) {
+  }
+
+  ~DefaultChangeCallbackHandleImpl() {
+    PulseAudioBackend::Get().RemoveCallback(mIterator);
+  }
+};
+
+struct DeviceChangeCallbackHandleImpl {
+  std::list<DeviceChangeCallback>::iterator mIterator;
+
+  explicit DeviceChangeCallbackHandleImpl(DeviceChangeCallback callback)
+    : mIterator(
+      PulseAudioBackend::Get().AddDeviceCallback(std::move(callback))) {
+  }
+
+  ~DeviceChangeCallbackHandleImpl() {
+    PulseAudioBackend::Get().RemoveDeviceCallback(mIterator);
+  }
+};
+
+std::map<std::string, AudioDeviceInfo> GetAudioDeviceList(
+  AudioDeviceDirection direction) {
+  return PulseAudioBackend::Get().GetDevices(direction);
+}
+
+AudioDeviceState GetAudioDeviceState(const std::string& id) {
+  return PulseAudioBackend::Get().GetState(id);
+}
+
+std::string GetDefaultAudioDeviceID(
+  AudioDeviceDirection direction,
+  AudioDeviceRole) {
+  return PulseAudioBackend::Get().GetDefault(direction);
+}
+
+void SetDefaultAudioDeviceID(
+  AudioDeviceDirection direction,
+  AudioDeviceRole,
+  const std::string& deviceID) {
+  PulseAudioBackend::Get().SetDefault(direction, deviceID);
+}
+
+DefaultChangeCallbackHandle AddDefaultAudioDeviceChangeCallback(
+  DefaultChangeCallback callback) {
+  return DefaultChangeCallbackHandle(
+    new DefaultChangeCallbackHandleImpl(std::move(callback)));
+}
+
+DeviceChangeCallbackHandle AddAudioDeviceChangeCallback(
+  DeviceChangeCallback callback) {
+  return DeviceChangeCallbackHandle(
+    new DeviceChangeCallbackHandleImpl(std::move(callback)));
+}
+
+}// namespace FredEmmott::Audio
@@ -0,0 +1,413 @@
+/* Copyright (c) 2018-present, Fred Emmott
+ *
+ * This source code is licensed under the MIT-style license found in the
+ * LICENSE file.
+ */
+
+#include <AudioDevices/AudioDeviceChanges.h>
+#include <AudioDevices/AudioDevices.h>
+#include <AudioDevices/SimulatedAudioDevices.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <list>
+#include <map>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+namespace FredEmmott::Audio {
+
+using DefaultChangeCallback = std::function<
+  void(AudioDeviceDirection, AudioDeviceRole, const std::string&)>;
+
+namespace {
+
+struct Notification {
+  AudioDeviceDirection direction;
+  AudioDeviceRole role;
+  std::string device;
+};
+
+class SimulatedBackend {
+ public:
+  static SimulatedBackend& Get() {
+    static SimulatedBackend sInstance;
+    return sInstance;
+  }
+
+  ~SimulatedBackend() {
+    {
+      std::scoped_lock lock(mNotificationsMutex);
+      mStopping = true;
+    }
+    mNotificationsCV.notify_all();
+    if (mDispatcher.joinable()) {
+      mDispatcher.join();
+    }
+  }
+
+  // Incremented by the AudioDevices.h functions
+  struct {
+    std::atomic<uint64_t> getAudioDeviceList{0};
+    std::atomic<uint64_t> getAudioDeviceState{0};
+    std::atomic<uint64_t> getDefaultAudioDeviceID{0};
+    std::atomic<uint64_t> setDefaultAudioDeviceID{0};
+  } mCallCounts;
+
+  void Delay() {
+    std::chrono::microseconds latency, jitter;
+    {
+      std::scoped_lock lock(mMutex);
+      latency = mLatency;
+      jitter = mJitter;
+    }
+    if (jitter.count() > 0) {
+      std::uniform_int_distribution<int64_t> distribution(0, jitter.count());
+      std::scoped_lock lock(mMutex);
+      latency += std::chrono::microseconds(distribution(mRandom));
+    }
+    if (latency.count() > 0) {
+      std::this_thread::sleep_for(latency);
+    }
+  }
+
+  std::map<std::string, AudioDeviceInfo> GetDevices(
+    AudioDeviceDirection direction) {
+    std::scoped_lock lock(mMutex);
+    std::map<std::string, AudioDeviceInfo> ret;
+    for (const auto& [id, device] : mDevices) {
+      if (device.direction == direction) {
+        ret.emplace(id, device);
+      }
+    }
+    return ret;
+  }
+
+  AudioDeviceState GetState(const std::string& id) {
+    std::scoped_lock lock(mMutex);
+    const auto it = mDevices.find(id);
+    if (it == mDevices.end()) {
+      return AudioDeviceState::DEVICE_NOT_PRESENT;
+    }
+    return it->second.state;
+  }
+
+  std::string GetDefault(AudioDeviceDirection direction, AudioDeviceRole role) {
+    std::scoped_lock lock(mMutex);
+    const auto it = mDefaults.find({direction, role});
+    if (it == mDefaults.end()) {
+      return {};
+    }
+    return it->second;
+  }
+
+  void SetDefault(
+    AudioDeviceDirection direction,
+    AudioDeviceRole role,
+    const std::string& id) {
+    {
+      std::scoped_lock lock(mMutex);
+      const auto it = mDevices.find(id);
+      if (
+        it == mDevices.end() || it->second.direction != direction
+        || it->second.state != AudioDeviceState::CONNECTED) {
+        return;
+      }
+      auto& current = mDefaults[{direction, role}];
+      if (current == id) {
+        return;
+      }
+      current = id;
+    }
+    Notify({direction, role, id});
+  }
+
+  void LoadGraph(std::istream& in) {
+    std::map<std::string, AudioDeviceInfo> devices;
+    std::map<std::tuple<AudioDeviceDirection, AudioDeviceRole>, std::string>
+      defaults;
+
+    std::string line;
+    while (std::getline(in, line)) {
+      if (line.empty() || line.front() == '#') {
+        continue;
+      }
+      std::vector<std::string> fields;
+      std::stringstream ss(line);
+      std::string field;
+      while (std::getline(ss, field, '\t')) {
+        fields.push_back(field);
+      }
+      if (fields.size() < 5) {
+        continue;
+      }
+
+      const auto direction = (fields[0] == "input")
+        ? AudioDeviceDirection::INPUT
+        : AudioDeviceDirection::OUTPUT;
+      AudioDeviceInfo device{
+        .id = fields[1],
+        .interfaceName = fields[2],
+        .endpointName = fields[3],
+        .displayName = fields[3] + " (" + fields[2] + ")",
+        .direction = direction,
+        .state = ParseState(fields[4]),
+      };
+      if (fields.size() >= 6) {
+        std::stringstream roles(fields[5]);
+        std::string role;
+        while (std::getline(roles, role, ',')) {
+          defaults[{
+            direction,
+            role == "communication" ? AudioDeviceRole::COMMUNICATION
+                                    : AudioDeviceRole::DEFAULT}]
+            = device.id;
+        }
+      }
+      devices.emplace(device.id, std::move(device));
+    }
+
+    std::scoped_lock lock(mMutex);
+    mDevices = std::move(devices);
+    mDefaults = std::move(defaults);
+  }
+
+  void AddDevice(const AudioDeviceInfo& device) {
+    std::scoped_lock lock(mMutex);
+    mDevices[device.id] = device;
+  }
+
+  void RemoveDevice(const std::string& id) {
+    std::scoped_lock lock(mMutex);
+    mDevices.erase(id);
+  }
+
+  void SetDeviceState(const std::string& id, AudioDeviceState state) {
+    std::scoped_lock lock(mMutex);
+    const auto it = mDevices.find(id);
+    if (it != mDevices.end()) {
+      it->second.state = state;
+    }
+  }
+
+  void SetLatency(
+    std::chrono::microseconds latency,
+    std::chrono::microseconds jitter) {
+    std::scoped_lock lock(mMutex);
+    mLatency = latency;
+    mJitter = jitter;
+  }
+
+  std::list<DefaultChangeCallback>::iterator AddCallback(
+    DefaultChangeCallback callback) {
+    std::scoped_lock lock(mCallbacksMutex);
+    return mCallbacks.insert(mCallbacks.end(), std::move(callback));
+  }
+
+  void RemoveCallback(std::list<DefaultChangeCallback>::iterator it) {
+    // Waits for any in-progress notification, so the callback's owner is
+    // safe to destroy once this returns
+    std::scoped_lock lock(mCallbacksMutex);
+    mCallbacks.erase(it);
+  }
+
+ private:
+  std::mutex mMutex;
+  std::map<std::string, AudioDeviceInfo> mDevices;
+  std::map<std::tuple<AudioDeviceDirection, AudioDeviceRole>, std::string>
+    mDefaults;
+  std::chrono::microseconds mLatency{0};
+  std::chrono::microseconds mJitter{0};
+  std::mt19937_64 mRandom{std::random_device{}()};
+
+  std::mutex mCallbacksMutex;
+  std::list<DefaultChangeCallback> mCallbacks;
+
+  std::mutex mNotificationsMutex;
+  std::condition_variable mNotificationsCV;
+  std::deque<Notification> mNotifications;
+  bool mStopping = false;
+  std::thread mDispatcher;
+
+  SimulatedBackend() {
+    const auto path = std::getenv("SDAUDIOSWITCH_SIMULATED_DEVICES");
+    if (path) {
+      std::ifstream f(path);
+      LoadGraph(f);
+    } else {
+      std::stringstream defaultGraph(
+        "output\tsim-headset-out\tUSB Headset\tHeadphones\tconnected\t"
+        "default,communication\n"
+        "output\tsim-speakers\tHD Audio\tSpeakers\tconnected\n"
+        "input\tsim-headset-in\tUSB Headset\tMicrophone\tconnected\t"
+        "default,communication\n"
+        "input\tsim-webcam\tWebcam\tMicrophone\tconnected\n");
+      LoadGraph(defaultGraph);
+    }
+
+    const auto latency = std::getenv("SDAUDIOSWITCH_SIMULATED_LATENCY_US");
+    const auto jitter = std::getenv("SDAUDIOSWITCH_SIMULATED_JITTER_US");
+    SetLatency(
+      std::chrono::microseconds(latency ? std::atoll(latency) : 0),
+      std::chrono::microseconds(jitter ? std::atoll(jitter) : 0));
+
+    mDispatcher = std::thread([this]() { DispatchNotifications(); });
+  }
+
+  static AudioDeviceState ParseState(const std::string& state) {
+    if (state == "device_not_present") {
+      return AudioDeviceState::DEVICE_NOT_PRESENT;
+    }
+    if (state == "device_disabled") {
+      return AudioDeviceState::DEVICE_DISABLED;
+    }
+    if (state == "device_present_no_connection") {
+      return AudioDeviceState::DEVICE_PRESENT_NO_CONNECTION;
+    }
+    return AudioDeviceState::CONNECTED;
+  }
+
+  void Notify(Notification notification) {
+    {
+      std::scoped_lock lock(mNotificationsMutex);
+      mNotifications.push_back(std::move(notification));
+    }
+    mNotificationsCV.notify_one();
+  }
+
+  // Like the real backends, notifications are delivered on a different
+  // thread to the one that made the change
+  void DispatchNotifications() {
+    while (true) {
+      Notification notification;
+      {
+        std::unique_lock lock(mNotificationsMutex);
+        mNotificationsCV.wait(
+          lock, [this]() { return mStopping || !mNotifications.empty(); });
+        if (mStopping) {
+          return;
+        }
+        notification = std::move(mNotifications.front());
+        mNotifications.pop_front();
+      }
+
+      Delay();
+      std::scoped_lock lock(mCallbacksMutex);
+      for (const auto& callback : mCallbacks) {
+        callback(
+          notification.direction, notification.role, notification.device);
+      }
+    }
+  }
+};
+
+}// namespace
+
+struct DefaultChangeCallbackHandleImpl {
+  std::list<DefaultChangeCallback>::iterator mIterator;
+
+  explicit DefaultChangeCallbackHandleImpl(DefaultChangeCallback callback)
+    : mIterator(SimulatedBackend::Get().AddCallback(std::move(callback))) {
+  }
+
+  ~DefaultChangeCallbackHandleImpl() {
+    SimulatedBackend::Get().RemoveCallback(mIterator);
+  }
+};
+
+std::map<std::string, AudioDeviceInfo> GetAudioDeviceList(
+  AudioDeviceDirection direction) {
+  auto& backend = SimulatedBackend::Get();
+  ++backend.mCallCounts.getAudioDeviceList;
+  backend.Delay();
+  return backend.GetDevices(direction);
+}
+
+AudioDeviceState GetAudioDeviceState(const std::string& id) {
+  auto& backend = SimulatedBackend::Get();
+  ++backend.mCallCounts.getAudioDeviceState;
+  backend.Delay();
+  return backend.GetState(id);
+}
+
+std::string GetDefaultAudioDeviceID(
+  AudioDeviceDirection direction,
+  AudioDeviceRole role) {
+  auto& backend = SimulatedBackend::Get();
+  ++backend.mCallCounts.getDefaultAudioDeviceID;
+  backend.Delay();
+  return backend.GetDefault(direction, role);
+}
+
+void SetDefaultAudioDeviceID(
+  AudioDeviceDirection direction,
+  AudioDeviceRole role,
+  const std::string& deviceID) {
+  auto& backend = SimulatedBackend::Get();
+  ++backend.mCallCounts.setDefaultAudioDeviceID;
+  backend.Delay();
+  backend.SetDefault(direction, role, deviceID);
+}
+
+DefaultChangeCallbackHandle AddDefaultAudioDeviceChangeCallback(
+  DefaultChangeCallback callback) {
+  return DefaultChangeCallbackHandle(
+    new DefaultChangeCallbackHandleImpl(std::move(callback)));
+}
+
+// The Simulated:: functions change devices without notifications, so device
+// states are probed on every lookup, and tools can count the probes
+DeviceChangeCallbackHandle AddAudioDeviceChangeCallback(DeviceChangeCallback) {
+  return nullptr;
+}
+
+namespace Simulated {
+
+bool LoadDeviceGraph(const std::string& path) {
+  std::ifstream f(path);
+  if (!f) {
+    return false;
+  }
+  SimulatedBackend::Get().LoadGraph(f);
+  return true;
+}
+
+void AddDevice(const AudioDeviceInfo& device) {
+  SimulatedBackend::Get().AddDevice(device);
+}
+
+void RemoveDevice(const std::string& id) {
+  SimulatedBackend::Get().RemoveDevice(id);
+}
+
+void SetDeviceState(const std::string& id, AudioDeviceState state) {
+  SimulatedBackend::Get().SetDeviceState(id, state);
+}
+
+void SetLatency(
+  std::chrono::microseconds latency,
+  std::chrono::microseconds jitter) {
+  SimulatedBackend::Get().SetLatency(latency, jitter);
+}
+
+CallCounts GetCallCounts() {
+  const auto& counts = SimulatedBackend::Get().mCallCounts;
+  return {
+    .getAudioDeviceList = counts.getAudioDeviceList,
+    .getAudioDeviceState = counts.getAudioDeviceState,
+    .getDefaultAudioDeviceID = counts.getDefaultAudioDeviceID,
+    .setDefaultAudioDeviceID = counts.setDefaultAudioDeviceID,
+  };
+}
+
+}// namespace Simulated
+
+}// namespace FredEmmott::Audio
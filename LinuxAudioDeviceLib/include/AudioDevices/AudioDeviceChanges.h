@@ -0,0 +1,36 @@
+/* Copyright (c) 2018-present, Fred Emmott
+ *
+ * This source code is licensed under the MIT-style license found in the
+ * LICENSE file.
+ */
+#pragma once
+
+#include <AudioDevices/AudioDevices.h>
+
+#include <functional>
+#include <memory>
+#include <string>
+
+// Linux only: device notifications from the backend.
+//
+// AudioDeviceLib only reports default device changes; on Windows and macOS
+// the plugin asks the OS about other changes itself, but on Linux only the
+// backend's connection can see them.
+namespace FredEmmott::Audio {
+
+// Called with a device's new state when it's added, removed, or changes
+// state; removed devices are DEVICE_NOT_PRESENT. An empty ID means that
+// any device may have changed, e.g. after reconnecting to the server.
+using DeviceChangeCallback
+  = std::function<void(const std::string& id, AudioDeviceState)>;
+
+struct DeviceChangeCallbackHandleImpl;
+typedef std::shared_ptr<DeviceChangeCallbackHandleImpl>
+  DeviceChangeCallbackHandle;
+
+// Returns null if the backend doesn't report device changes. Callbacks are
+// called on another thread; destroying the handle waits for any call in
+// progress.
+DeviceChangeCallbackHandle AddAudioDeviceChangeCallback(DeviceChangeCallback);
+
+}// namespace FredEmmott::Audio
@@ -0,0 +1,60 @@
+/* Copyright (c) 2018-present, Fred Emmott
+ *
+ * This source code is licensed under the MIT-style license found in the
+ * LICENSE file.
+ */
+#pragma once
+
+#include <AudioDevices/AudioDevices.h>
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// Scripting interface for the in-memory backend, used on Linux when built
+// with LINUX_AUDIO_BACKEND=Simulated.
+//
+// The rest of the plugin only uses the normal AudioDevices.h functions; this
+// is for driving the device graph from tools and benchmarks. On startup, the
+// graph is loaded from the file named by SDAUDIOSWITCH_SIMULATED_DEVICES if
+// set, otherwise it contains one headset and one pair of speakers.
+//
+// File format: one device per line, tab-separated:
+//
+//   direction  id  interfaceName  endpointName  state  [roles]
+//
+// where `direction` is `input` or `output`, `state` is one of `connected`,
+// `device_not_present`, `device_disabled`, or
+// `device_present_no_connection`, and `roles` is an optional comma-separated
+// list of `default` and `communication` for which this device is the
+// default. Blank lines and lines starting with `#` are ignored.
+//
+// Latency and jitter can also be set with SDAUDIOSWITCH_SIMULATED_LATENCY_US
+// and SDAUDIOSWITCH_SIMULATED_JITTER_US.
+namespace FredEmmott::Audio::Simulated {
+
+// Replaces the device graph, and clears all defaults
+bool LoadDeviceGraph(const std::string& path);
+
+// Adds or replaces a device
+void AddDevice(const AudioDeviceInfo&);
+void RemoveDevice(const std::string& id);
+void SetDeviceState(const std::string& id, AudioDeviceState);
+
+// Applied to every call into the backend: each call sleeps for `latency`,
+// plus a uniformly random extra delay of up to `jitter`
+void SetLatency(
+  std::chrono::microseconds latency,
+  std::chrono::microseconds jitter = {});
+
+// Calls made through AudioDevices.h since startup, so benchmarks can show
+// how often the plugin enumerates or probes
+struct CallCounts {
+  uint64_t getAudioDeviceList = 0;
+  uint64_t getAudioDeviceState = 0;
+  uint64_t getDefaultAudioDeviceID = 0;
+  uint64_t setDefaultAudioDeviceID = 0;
+};
+CallCounts GetCallCounts();
+
+}// namespace FredEmmott::Audio::Simulated
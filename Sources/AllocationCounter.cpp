@@ -0,0 +1,36 @@
+/* Copyright (c) 2018-present, Fred Emmott
+ *
+ * This source code is licensed under the MIT-style license found in the
+ * LICENSE file.
+ */
+
+#include "AllocationCounter.h"
+
+#include <cstdlib>
+#include <new>
+
+namespace {
+// Per-thread, so counting doesn't need any synchronization
+thread_local uint64_t gAllocationCount = 0;
+}// namespace
+
+uint64_t GetThreadAllocationCount() {
+  return gAllocationCount;
+}
+
+// The other non-aligned forms (array, nothrow) call these by default
+void* operator new(std::size_t size) {
+  ++gAllocationCount;
+  if (void* p = std::malloc(size ? size : 1)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+  std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+  std::free(p);
+}
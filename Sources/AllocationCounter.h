@@ -0,0 +1,38 @@
+/* Copyright (c) 2018-present, Fred Emmott
+ *
+ * This source code is licensed under the MIT-style license found in the
+ * LICENSE file.
+ */
+#pragma once
+
+#include <cstdint>
+
+// Counting replaces the global operator new, so it's only built if the
+// ENABLE_ALLOCATION_COUNTING CMake option is on; otherwise, counts are
+// always 0.
+#ifdef ENABLE_ALLOCATION_COUNTING
+constexpr bool ALLOCATION_COUNTING_ENABLED = true;
+
+// Heap allocations made by the calling thread so far
+uint64_t GetThreadAllocationCount();
+#else
+constexpr bool ALLOCATION_COUNTING_ENABLED = false;
+
+inline uint64_t GetThreadAllocationCount() {
+  return 0;
+}
+#endif
+
+// Counts the allocations the current thread makes during a scope
+class ScopedAllocationCount {
+ public:
+  ScopedAllocationCount() : mStart(GetThreadAllocationCount()) {
+  }
+
+  uint64_t Get() const {
+    return GetThreadAllocationCount() - mStart;
+  }
+
+ private:
+  uint64_t mStart;
+};
@@ -0,0 +1,315 @@
+/* Copyright (c) 2018-present, Fred Emmott
+ *
+ * This source code is licensed under the MIT-style license found in the
+ * LICENSE file.
+ */
+
+#include "AudioDeviceCache.h"
+
+#include <StreamDeckSDK/ESDLogger.h>
+
+#include <algorithm>
+#include <fstream>
+#include <vector>
+
+#include "audio_binary.h"
+#include "DebugLog.h"
+
+namespace {
+
+constexpr std::string_view PERSISTED_MAGIC{"SDAD"};
+// Bump if the file layout changes; other versions are ignored
+constexpr uint32_t PERSISTED_FORMAT_VERSION = 2;
+
+void BuildFuzzyIndex(AudioDeviceSnapshot& snapshot) {
+  for (const auto& [id, device] : snapshot.devices) {
+    if (device.state != AudioDeviceState::CONNECTED) {
+      continue;
+    }
+    // try_emplace: if there are several matches, the first wins
+    snapshot.fuzzyIndex.try_emplace(
+      FuzzyDeviceKey(device), InternDeviceID(id));
+  }
+}
+
+bool SameDevices(
+  const std::map<std::string, AudioDeviceInfo>& a,
+  const std::map<std::string, AudioDeviceInfo>& b) {
+  return std::ranges::equal(a, b, [](const auto& x, const auto& y) {
+    const auto& [xID, xDevice] = x;
+    const auto& [yID, yDevice] = y;
+    return xID == yID && xDevice.interfaceName == yDevice.interfaceName
+      && xDevice.endpointName == yDevice.endpointName
+      && xDevice.displayName == yDevice.displayName
+      && xDevice.direction == yDevice.direction
+      && xDevice.state == yDevice.state;
+  });
+}
+
+}// namespace
+
+std::string_view FuzzifyInterface(std::string_view name) {
+  // Equivalent to matching `^([0-9]+- )?(.+)$` and taking the second group,
+  // without building a regex each time.
+  //
+  // `.` doesn't match line terminators, so the regex didn't match at all if
+  // there was one
+  if (name.find_first_of("\r\n") != name.npos) {
+    return name;
+  }
+  size_t i = 0;
+  while (i < name.size() && name[i] >= '0' && name[i] <= '9') {
+    ++i;
+  }
+  if (i == 0 || name.substr(i, 2) != "- " || name.size() == i + 2) {
+    return name;
+  }
+  return name.substr(i + 2);
+}
+
+std::string FuzzyDeviceKey(const AudioDeviceInfo& device) {
+  const auto fuzzyInterface = FuzzifyInterface(device.interfaceName);
+  std::string key;
+  key.reserve(fuzzyInterface.size() + 1 + device.endpointName.size());
+  key.append(fuzzyInterface);
+  // Not valid in either name, so "a" + "bc" can't collide with "ab" + "c"
+  key.push_back('\0');
+  key.append(device.endpointName);
+  return key;
+}
+
+DeviceHandle AudioDeviceSnapshot::FindFuzzyMatch(
+  const AudioDeviceInfo& device) const {
+  const auto it = fuzzyIndex.find(FuzzyDeviceKey(device));
+  if (it == fuzzyIndex.end()) {
+    return NO_DEVICE;
+  }
+  return it->second;
+}
+
+std::shared_ptr<const AudioDeviceSnapshot> AudioDeviceCache::Get(
+  AudioDeviceDirection direction) {
+  std::unique_lock lock(mMutex);
+  auto& snapshot = mSnapshots[direction];
+  if (snapshot) {
+    return snapshot;
+  }
+
+  // Enumerate while holding the lock: if several buttons miss at once, only
+  // the first one should pay for it.
+  auto fresh = Enumerate(direction);
+  const auto changed = Store(fresh);
+  lock.unlock();
+
+  if (changed) {
+    ScheduleSave();
+  }
+  return fresh;
+}
+
+std::shared_ptr<const AudioDeviceSnapshot> AudioDeviceCache::Refresh(
+  AudioDeviceDirection direction) {
+  auto fresh = Enumerate(direction);
+  bool changed = false;
+  {
+    std::scoped_lock lock(mMutex);
+    changed = Store(fresh);
+  }
+  if (changed) {
+    ScheduleSave();
+  }
+  return fresh;
+}
+
+std::shared_ptr<const AudioDeviceSnapshot> AudioDeviceCache::RefreshIfOlderThan(
+  AudioDeviceDirection direction,
+  std::chrono::steady_clock::duration maxAge) {
+  std::unique_lock lock(mMutex);
+  const auto it = mSnapshots.find(direction);
+  if (
+    it != mSnapshots.end()
+    && std::chrono::steady_clock::now() - it->second->enumeratedAt < maxAge) {
+    return it->second;
+  }
+
+  // As in Get(), hold the lock so concurrent misses only enumerate once
+  auto fresh = Enumerate(direction);
+  const auto changed = Store(fresh);
+  lock.unlock();
+
+  if (changed) {
+    ScheduleSave();
+  }
+  return fresh;
+}
+
+bool AudioDeviceCache::Store(
+  const std::shared_ptr<AudioDeviceSnapshot>& fresh) {
+  auto& snapshot = mSnapshots[fresh->direction];
+  const bool changed
+    = !(snapshot && SameDevices(snapshot->devices, fresh->devices));
+  // Anything resolved against the same devices is still valid, e.g. cycle
+  // orders, so keep the version
+  fresh->version = changed ? ++mVersion : snapshot->version;
+  snapshot = fresh;
+  return changed;
+}
+
+std::shared_ptr<AudioDeviceSnapshot> AudioDeviceCache::Enumerate(
+  AudioDeviceDirection direction) {
+  auto fresh = std::make_shared<AudioDeviceSnapshot>();
+  fresh->direction = direction;
+  fresh->enumeratedAt = std::chrono::steady_clock::now();
+  fresh->devices = GetAudioDeviceList(direction);
+  BuildFuzzyIndex(*fresh);
+
+  const auto count = ++mEnumerationCount;
+  PluginDebug(
+    "Enumerated {} devices ({} enumerations so far)",
+    fresh->devices.size(),
+    count);
+  return fresh;
+}
+
+bool AudioDeviceCache::SetPersistentPath(
+  const std::filesystem::path& path,
+  SaveScheduler scheduleSave) {
+  {
+    std::scoped_lock lock(mMutex);
+    mPersistentPath = path;
+    mScheduleSave = std::move(scheduleSave);
+  }
+
+  // Read in one go rather than memory-mapping: this happens once, and
+  // reading is a small part of loading; see CodecBenchmark
+  std::error_code ec;
+  const auto size = std::filesystem::file_size(path, ec);
+  if (ec) {
+    return false;
+  }
+  std::string data(size, '\0');
+  std::ifstream f(path, std::ios::binary);
+  if (!f.read(data.data(), data.size())) {
+    return false;
+  }
+  std::string_view in(data);
+  uint32_t version = 0;
+  if (!in.starts_with(PERSISTED_MAGIC)) {
+    ESDLog("Ignoring unrecognized device cache {}", path.string());
+    return false;
+  }
+  in.remove_prefix(PERSISTED_MAGIC.size());
+  if (!ReadBinary(in, version) || version != PERSISTED_FORMAT_VERSION) {
+    ESDLog("Ignoring device cache {} from another version", path.string());
+    return false;
+  }
+
+  std::vector<std::shared_ptr<AudioDeviceSnapshot>> loaded;
+  uint32_t count = 0;
+  bool valid = ReadBinary(in, count);
+  for (uint32_t i = 0; valid && i < count; ++i) {
+    auto snapshot = std::make_shared<AudioDeviceSnapshot>();
+    snapshot->persisted = true;
+    valid = ReadBinary(in, snapshot->direction)
+      && ReadBinary(in, snapshot->devices);
+    BuildFuzzyIndex(*snapshot);
+    loaded.push_back(std::move(snapshot));
+  }
+  if (!valid || !in.empty()) {
+    // Truncated or corrupt; just start without it
+    ESDLog("Ignoring invalid device cache {}", path.string());
+    return false;
+  }
+
+  std::scoped_lock lock(mMutex);
+  for (auto& snapshot : loaded) {
+    // If something's already been enumerated, that's more up to date
+    if (mSnapshots.contains(snapshot->direction)) {
+      continue;
+    }
+    snapshot->version = ++mVersion;
+    PluginDebug(
+      "Loaded {} devices from disk as snapshot v{}",
+      snapshot->devices.size(),
+      snapshot->version);
+    mSnapshots[snapshot->direction] = std::move(snapshot);
+  }
+  return !loaded.empty();
+}
+
+void AudioDeviceCache::ScheduleSave() {
+  SaveScheduler scheduleSave;
+  {
+    std::scoped_lock lock(mMutex);
+    if (mPersistentPath.empty() || mSavePending) {
+      return;
+    }
+    mSavePending = true;
+    scheduleSave = mScheduleSave;
+  }
+  if (!scheduleSave) {
+    Save();
+    return;
+  }
+  scheduleSave([this]() { Save(); });
+}
+
+void AudioDeviceCache::Save() {
+  std::scoped_lock saveLock(mSaveMutex);
+  std::filesystem::path path;
+  std::string data(PERSISTED_MAGIC);
+  AppendBinary(data, PERSISTED_FORMAT_VERSION);
+  {
+    std::scoped_lock lock(mMutex);
+    mSavePending = false;
+    if (mPersistentPath.empty()) {
+      return;
+    }
+    path = mPersistentPath;
+    AppendBinary(data, static_cast<uint32_t>(mSnapshots.size()));
+    for (const auto& [direction, snapshot] : mSnapshots) {
+      AppendBinary(data, direction);
+      AppendBinary(data, snapshot->devices);
+    }
+  }
+
+  // Write then rename, so a crash can't leave a partial file
+  auto tmpPath = path;
+  tmpPath += ".tmp";
+  {
+    std::ofstream f(tmpPath, std::ios::binary | std::ios::trunc);
+    f.write(data.data(), data.size());
+    if (!f) {
+      ESDLog("Failed to write device cache to {}", tmpPath.string());
+      return;
+    }
+  }
+  std::error_code ec;
+  std::filesystem::rename(tmpPath, path, ec);
+  if (ec) {
+    ESDLog(
+      "Failed to save device cache to {}: {}", path.string(), ec.message());
+  }
+}
+
+void AudioDeviceCache::Invalidate(AudioDeviceDirection direction) {
+  std::scoped_lock lock(mMutex);
+  mSnapshots.erase(direction);
+}
+
+void AudioDeviceCache::InvalidateAll() {
+  std::scoped_lock lock(mMutex);
+  mSnapshots.clear();
+}
+
+uint64_t AudioDeviceCache::GetEnumerationCount() const {
+  return mEnumerationCount;
+}
+
+AudioDeviceState AudioDeviceCache::GetState(DeviceHandle device) {
+  return mStates.Get(device);
+}
+
+DeviceStateTable& AudioDeviceCache::GetStateTable() {
+  return mStates;
+}
@@ -0,0 +1,113 @@
+/* Copyright (c) 2018-present, Fred Emmott
+ *
+ * This source code is licensed under the MIT-style license found in the
+ * LICENSE file.
+ */
+#pragma once
+
+#include <AudioDevices/AudioDevices.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "DeviceIDTable.h"
+#include "DeviceStateTable.h"
+
+using namespace FredEmmott::Audio;
+
+// The devices for one direction, as of a single enumeration. Never modified
+// after creation, so can be shared between threads without locking.
+struct AudioDeviceSnapshot {
+  AudioDeviceDirection direction;
+  // Only changes when the devices do, so anything derived from a snapshot
+  // can be reused for a later one with the same version
+  uint64_t version = 0;
+  // Epoch if loaded from disk
+  std::chrono::steady_clock::time_point enumeratedAt;
+  // Loaded from disk rather than enumerated by this process
+  bool persisted = false;
+  std::map<std::string, AudioDeviceInfo> devices;
+
+  // Connected devices by FuzzyDeviceKey()
+  std::unordered_map<std::string, DeviceHandle> fuzzyIndex;
+
+  // Returns a connected device that looks like the same hardware as
+  // `device`, or NO_DEVICE.
+  DeviceHandle FindFuzzyMatch(const AudioDeviceInfo& device) const;
+};
+
+// Windows likes to replace "Foo" with "2- Foo"
+std::string_view FuzzifyInterface(std::string_view interfaceName);
+std::string FuzzyDeviceKey(const AudioDeviceInfo&);
+
+// Enumerating devices is expensive - especially on Windows with lots of
+// virtual endpoints - so keep the latest list for each direction until we're
+// told it's out of date.
+//
+// The latest lists are also saved to disk, so that after a restart buttons
+// can be drawn before the first enumeration finishes.
+class AudioDeviceCache {
+ public:
+  std::shared_ptr<const AudioDeviceSnapshot> Get(AudioDeviceDirection);
+  // Enumerates again; unlike Invalidate() + Get(), other threads keep getting
+  // the previous snapshot until this one is ready.
+  std::shared_ptr<const AudioDeviceSnapshot> Refresh(AudioDeviceDirection);
+  // Enumerates again if the snapshot is older than `maxAge`. We aren't
+  // always told when devices are added, so this lets a failed lookup check
+  // for new devices without every failure enumerating.
+  std::shared_ptr<const AudioDeviceSnapshot> RefreshIfOlderThan(
+    AudioDeviceDirection,
+    std::chrono::steady_clock::duration maxAge);
+
+  void Invalidate(AudioDeviceDirection);
+  void InvalidateAll();
+
+  // Runs a save later, e.g. on a worker thread; the cache must outlive it
+  using SaveScheduler = std::function<void(std::function<void()> save)>;
+  // Loads any snapshots saved by a previous run, and saves future snapshots
+  // to the same file. Saves are passed to `scheduleSave` so that they don't
+  // delay whoever enumerated; if it's empty, they're done straight away.
+  // Returns false if nothing was loaded.
+  bool SetPersistentPath(
+    const std::filesystem::path&,
+    SaveScheduler scheduleSave = {});
+
+  uint64_t GetEnumerationCount() const;
+
+  // Usually from memory; see DeviceStateTable
+  AudioDeviceState GetState(DeviceHandle);
+  DeviceStateTable& GetStateTable();
+
+ private:
+  std::shared_ptr<AudioDeviceSnapshot> Enumerate(AudioDeviceDirection);
+  // Requires mMutex. Replaces the snapshot for `fresh`'s direction, and sets
+  // its version; returns false if the devices are the same as before.
+  bool Store(const std::shared_ptr<AudioDeviceSnapshot>&);
+  // Schedules a save, unless one is already waiting to run
+  void ScheduleSave();
+  void Save();
+
+  std::mutex mMutex;
+  std::filesystem::path mPersistentPath;
+  SaveScheduler mScheduleSave;
+  // A scheduled save hasn't started serializing yet, so will include any
+  // newer snapshots; guarded by mMutex
+  bool mSavePending = false;
+  // Held from serializing until the file is written, so that an older save
+  // can't overwrite a newer one
+  std::mutex mSaveMutex;
+  uint64_t mVersion = 0;
+  std::map<AudioDeviceDirection, std::shared_ptr<const AudioDeviceSnapshot>>
+    mSnapshots;
+  std::atomic<uint64_t> mEnumerationCount{0};
+  DeviceStateTable mStates;
+};
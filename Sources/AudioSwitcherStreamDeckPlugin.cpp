@@ -20,22 +20,18 @@ LICENSE file.
 #include <StreamDeckSDK/ESDLogger.h>
 
 #include <atomic>
+#include <chrono>
 #include <functional>
 #include <mutex>
+#include <vector>
 
 #ifdef _MSC_VER
 #include <objbase.h>
 #endif
 
+#include "AllocationCounter.h"
 #include "audio_json.h"
-
-// Add Windows and macOS specific includes
-#ifdef _WIN32
-#include <windows.h>
-#elif defined(__APPLE__)
-#include <ApplicationServices/ApplicationServices.h>
-#include <unistd.h>
-#endif
+#include "DebugLog.h"
 
 // Remove custom file logging
 #include <ctime>
@@ -50,8 +46,67 @@ constexpr std::string_view SET_ACTION_ID{
   "com.fredemmott.audiooutputswitch.set"};
 constexpr std::string_view TOGGLE_ACTION_ID{
   "com.fredemmott.audiooutputswitch.toggle"};
+constexpr std::string_view MULTI_SET_ACTION_ID{
+  "com.fredemmott.audiooutputswitch.multiset"};
+constexpr std::string_view CYCLE_ACTION_ID{
+  "com.fredemmott.audiooutputswitch.cycle"};
+
+// Not a real state; SendState() shows an alert instead
+constexpr int ALERT_STATE = -1;
+
+// Long enough to catch the per-role notifications from a single switch
+constexpr std::chrono::milliseconds DEFAULT_DEVICE_CHANGE_COALESCING_WINDOW{
+  50};
 
-bool FillAudioDeviceInfo(AudioDeviceInfo& di) {
+// Relative to the working directory, which is the plugin's directory
+constexpr std::string_view DEVICE_CACHE_FILE{"deviceCache.bin"};
+
+bool SameExceptState(const AudioDeviceInfo& a, const AudioDeviceInfo& b) {
+  return a.interfaceName == b.interfaceName && a.endpointName == b.endpointName
+    && a.displayName == b.displayName && a.direction == b.direction;
+}
+
+// The changes to get from `before` to `after`, as a list of operations for
+// the property inspector
+json DiffDeviceLists(
+  const std::map<std::string, AudioDeviceInfo>& before,
+  const std::map<std::string, AudioDeviceInfo>& after) {
+  auto ops = json::array();
+  // Both are sorted by ID, so walk them together
+  auto b = before.begin();
+  auto a = after.begin();
+  while (b != before.end() || a != after.end()) {
+    if (a == after.end() || (b != before.end() && b->first < a->first)) {
+      ops.push_back({{"op", "remove"}, {"id", b->first}});
+      ++b;
+      continue;
+    }
+    if (b == before.end() || a->first < b->first) {
+      ops.push_back({{"op", "add"}, {"device", a->second}});
+      ++a;
+      continue;
+    }
+
+    const auto& was = b->second;
+    const auto& now = a->second;
+    if (!SameExceptState(was, now)) {
+      // Replaces the existing entry
+      ops.push_back({{"op", "add"}, {"device", now}});
+    } else if (was.state != now.state) {
+      ops.push_back({{"op", "state"}, {"id", now.id}, {"state", now.state}});
+    }
+    ++a;
+    ++b;
+  }
+  return ops;
+}
+
+uint64_t ElapsedMilliseconds(std::chrono::steady_clock::duration duration) {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(duration)
+    .count();
+}
+
+bool FillAudioDeviceInfo(AudioDeviceInfo& di, AudioDeviceCache& cache) {
   if (di.id.empty()) {
     return false;
   }
@@ -59,17 +114,28 @@ bool FillAudioDeviceInfo(AudioDeviceInfo& di) {
     return false;
   }
 
-  const auto devices = GetAudioDeviceList(di.direction);
-  if (!devices.contains(di.id)) {
+  const auto snapshot = cache.Get(di.direction);
+  const auto it = snapshot->devices.find(di.id);
+  if (it == snapshot->devices.end()) {
     return false;
   }
-  di = devices.at(di.id);
+  di = it->second;
   return true;
 }
 
 }// namespace
 
-AudioSwitcherStreamDeckPlugin::AudioSwitcherStreamDeckPlugin() {
+AudioSwitcherStreamDeckPlugin::AudioSwitcherStreamDeckPlugin(
+  std::unique_ptr<OutboundMessageSink> sink)
+  : mOutboundMessages(
+    sink ? std::move(sink)
+         : std::make_unique<ESDConnectionManagerSink>(mConnectionManager),
+    mLatencyStats),
+    mDefaultDeviceChangeCoalescer(
+      DEFAULT_DEVICE_CHANGE_COALESCING_WINDOW,
+      std::bind_front(
+        &AudioSwitcherStreamDeckPlugin::OnDefaultDeviceChangesCoalesced,
+        this)) {
   // Remove FileLog calls
 #ifdef _MSC_VER
   CoInitializeEx(
@@ -77,26 +143,220 @@ AudioSwitcherStreamDeckPlugin::AudioSwitcherStreamDeckPlugin() {
 #endif
   mCallbackHandle = AddDefaultAudioDeviceChangeCallback(std::bind_front(
     &AudioSwitcherStreamDeckPlugin::OnDefaultDeviceChanged, this));
+  mDeviceCache.GetStateTable().SetChangeCallback(std::bind_front(
+    &AudioSwitcherStreamDeckPlugin::OnDeviceStateChanged, this));
+  if (!mDeviceCache.GetStateTable().StartTracking()) {
+    PluginDebug("Device state notifications unavailable, probing instead");
+  }
+
+  // Draw buttons from the last run's device lists, and enumerate in the
+  // background
+  const auto scheduleSave = [this](std::function<void()> save) {
+    mSwitchExecutor.Enqueue("Save device lists", std::move(save));
+  };
+  if (mDeviceCache.SetPersistentPath(DEVICE_CACHE_FILE, scheduleSave)) {
+    PluginDebug("Using saved device lists until enumeration completes");
+  }
+  mSwitchExecutor.Enqueue(
+    "Reconcile device cache", [this]() { ReconcileDeviceCache(); });
 }
 
 AudioSwitcherStreamDeckPlugin::~AudioSwitcherStreamDeckPlugin() {
   mCallbackHandle = {};
+  mDeviceCache.GetStateTable().SetChangeCallback({});
+}
+
+void AudioSwitcherStreamDeckPlugin::ReconcileDeviceCache() {
+  for (const auto direction :
+       {AudioDeviceDirection::OUTPUT, AudioDeviceDirection::INPUT}) {
+    mDeviceCache.Refresh(direction);
+  }
+  // Anything resolved against the saved lists may be wrong
+  ++mDeviceGeneration;
+
+  // Not `mButtons.Get()->buttons`: that would destroy the snapshot before
+  // the loop body runs
+  const auto buttons = mButtons.Get();
+  for (const auto& [context, button] : buttons->buttons) {
+    UpdateState(*button);
+  }
+
+  PublishDeviceListChanges();
+
+  const auto elapsed = std::chrono::steady_clock::now() - mStartedAt;
+  mLatencyStats.Record(LatencyStage::StartupToReconciled, elapsed);
+  ESDLog(
+    "Device lists reconciled {}ms after startup", ElapsedMilliseconds(elapsed));
 }
 
 void AudioSwitcherStreamDeckPlugin::OnDefaultDeviceChanged(
   AudioDeviceDirection direction,
   AudioDeviceRole role,
-  const std::string& device) {
-  std::scoped_lock lock(mVisibleContextsMutex);
-  for (const auto& [context, button] : mButtons) {
-    if (button.settings.direction != direction) {
+  const std::string& deviceID) {
+  const ScopedAllocationCount allocations;
+  const auto device = InternDeviceID(deviceID);
+  mDefaultDevices.Set(direction, role, device);
+  // Invalidates any speculative switches
+  ++mDeviceGeneration;
+
+  // Not every platform notifies us about devices being added or removed,
+  // but a new default device is often a new device. Refreshing rather than
+  // invalidating keeps the snapshot - and anything resolved against it, like
+  // cycle orders - if the devices are the same, which they usually are.
+  QueueDeviceListRefresh();
+
+  {
+    std::scoped_lock lock(mPendingSwitchesMutex);
+    const auto it = mPendingSwitches.find({direction, role});
+    if (it != mPendingSwitches.end() && it->second.device == device) {
+      mLatencyStats.Record(
+        LatencyStage::DefaultChangeRoundTrip,
+        std::chrono::steady_clock::now() - it->second.startedAt);
+      mPendingSwitches.erase(it);
+    }
+  }
+
+  mHotkeyDispatcher.OnDefaultDeviceChanged(direction, role, device);
+  mDefaultDeviceChangeCoalescer.Push(direction, role, device);
+  if constexpr (ALLOCATION_COUNTING_ENABLED) {
+    PluginDebug(
+      "Default device notification: {} allocations", allocations.Get());
+  }
+}
+
+void AudioSwitcherStreamDeckPlugin::OnDeviceStateChanged(
+  DeviceHandle device) {
+  // Invalidates any speculative switches
+  ++mDeviceGeneration;
+
+  // A device was added, removed, or changed state, so the device lists are
+  // out of date
+  QueueDeviceListRefresh();
+
+  mSwitchExecutor.Enqueue("Update cycle orders", [this, device]() {
+    if (device == NO_DEVICE) {
+      for (auto& [context, order] : mCycleOrders) {
+        order.Invalidate();
+      }
+      return;
+    }
+    const auto connected
+      = mDeviceCache.GetState(device) == AudioDeviceState::CONNECTED;
+    for (auto& [context, order] : mCycleOrders) {
+      order.SetConnected(device, connected);
+    }
+  });
+}
+
+void AudioSwitcherStreamDeckPlugin::QueueDeviceListRefresh() {
+  // Enumerate on the executor rather than invalidating, so key presses keep
+  // using the previous lists until then, and only once for a burst of
+  // notifications.
+  if (mDeviceListRefreshPending.exchange(true)) {
+    return;
+  }
+  mSwitchExecutor.Enqueue("Refresh device lists after a change", [this]() {
+    mDeviceListRefreshPending = false;
+    mDeviceCache.Refresh(AudioDeviceDirection::OUTPUT);
+    mDeviceCache.Refresh(AudioDeviceDirection::INPUT);
+    if (!mDeviceListSubscribers.empty()) {
+      PublishDeviceListChanges();
+    }
+  });
+}
+
+void AudioSwitcherStreamDeckPlugin::OnDefaultDeviceChangesCoalesced(
+  const DefaultDeviceChangeCoalescer::Changes& changes) {
+  const ScopedAllocationCount allocations;
+  const auto buttons = mButtons.Get();
+  for (const auto& [key, change] : changes) {
+    const auto it = buttons->buttonsByDirectionAndRole.find(key);
+    if (it == buttons->buttonsByDirectionAndRole.end()) {
+      continue;
+    }
+    for (const auto& button : *it->second) {
+      UpdateState(*button, change.device);
+    }
+    mSuppressedStateUpdates
+      += (change.notificationCount - 1) * it->second->size();
+  }
+  PluginDebug(
+    "Coalesced {} default device notifications into {} bursts; suppressed {} "
+    "state updates; skipped {} unchanged state messages",
+    mDefaultDeviceChangeCoalescer.GetNotificationCount(),
+    mDefaultDeviceChangeCoalescer.GetBurstCount(),
+    mSuppressedStateUpdates.load(),
+    mSkippedStateMessages.load());
+  if constexpr (ALLOCATION_COUNTING_ENABLED) {
+    PluginDebug("Coalesced notifications: {} allocations", allocations.Get());
+  }
+}
+
+void AudioSwitcherStreamDeckPlugin::PublishDeviceListChanges() {
+  json delta{
+    {"event", "deviceListDelta"},
+    {"fromGeneration", mDeviceListGeneration},
+  };
+  bool changed = false;
+  for (const auto& [direction, key] : {
+         std::pair{AudioDeviceDirection::OUTPUT, "outputDevices"},
+         std::pair{AudioDeviceDirection::INPUT, "inputDevices"},
+       }) {
+    auto& published = mPublishedDeviceLists[direction];
+    const auto current = mDeviceCache.Get(direction);
+    if (published == current) {
+      delta[key] = json::array();
       continue;
     }
-    if (button.settings.role != role) {
+    // Nobody to tell, so don't bother working out what changed
+    if (mDeviceListSubscribers.empty()) {
+      published = current;
+      changed = true;
       continue;
     }
-    UpdateState(context, device);
+
+    static const std::map<std::string, AudioDeviceInfo> empty;
+    delta[key] = DiffDeviceLists(
+      published ? published->devices : empty, current->devices);
+    changed |= !delta[key].empty();
+    published = current;
+  }
+
+  if (!changed) {
+    return;
+  }
+  delta["generation"] = ++mDeviceListGeneration;
+  if (mDeviceListSubscribers.empty()) {
+    return;
   }
+
+  PluginDebug(
+    "Sending device list delta {} -> {} ({} bytes) to {} property "
+    "inspectors",
+    mDeviceListGeneration - 1,
+    mDeviceListGeneration,
+    delta.dump().size(),
+    mDeviceListSubscribers.size());
+  for (const auto& [context, action] : mDeviceListSubscribers) {
+    mConnectionManager->SendToPropertyInspector(action, context, delta);
+  }
+}
+
+std::vector<std::pair<AudioDeviceDirection, AudioDeviceRole>>
+AudioSwitcherStreamDeckPlugin::GetDirectionsAndRoles(const Button& button) {
+  if (button.action == CYCLE_ACTION_ID) {
+    // Single-state, so nothing to update when the default changes
+    return {};
+  }
+  if (button.action != MULTI_SET_ACTION_ID) {
+    return {{button.settings.direction, button.settings.role}};
+  }
+
+  std::vector<std::pair<AudioDeviceDirection, AudioDeviceRole>> ret;
+  for (const auto& target : button.settings.targets) {
+    ret.push_back({target.direction, target.role});
+  }
+  return ret;
 }
 
 void AudioSwitcherStreamDeckPlugin::KeyDownForAction(
@@ -104,7 +364,24 @@ void AudioSwitcherStreamDeckPlugin::KeyDownForAction(
   const std::string& inContext,
   const json& inPayload,
   const std::string& inDeviceID) {
-  const auto state = EPLJSONUtils::GetIntByName(inPayload, "state");
+  const auto eventTimer = mLatencyStats.Measure(LatencyStage::KeyDownEvent);
+  const ScopedAllocationCount allocations;
+  auto request = PrepareSwitch(inAction, inContext, inPayload);
+  if (
+    !request || inAction == MULTI_SET_ACTION_ID
+    || inAction == CYCLE_ACTION_ID) {
+    return;
+  }
+
+  // Do the slow part now, so key-up only needs to make the change
+  mSwitchExecutor.Enqueue(
+    "Resolve " + inContext, [this, request = std::move(*request)]() {
+      mSpeculativeSwitches.insert_or_assign(
+        request.button->context, ResolveSwitch(request));
+    });
+  if constexpr (ALLOCATION_COUNTING_ENABLED) {
+    PluginDebug("Key down: {} allocations", allocations.Get());
+  }
 }
 
 void AudioSwitcherStreamDeckPlugin::KeyUpForAction(
@@ -112,63 +389,370 @@ void AudioSwitcherStreamDeckPlugin::KeyUpForAction(
   const std::string& inContext,
   const json& inPayload,
   const std::string& inDeviceID) {
-  ESDDebug("{}: {}", __FUNCTION__, inPayload.dump());
-  std::scoped_lock lock(mVisibleContextsMutex);
+  const auto keyUpAt = std::chrono::steady_clock::now();
+  const auto eventTimer = mLatencyStats.Measure(LatencyStage::KeyUpEvent);
+  const ScopedAllocationCount eventAllocations;
+  PluginDebug("{}: {}", __FUNCTION__, LogJSON{inPayload});
+  {
+    std::scoped_lock lock(mStatesMutex);
+    // Stream Deck changes the state itself when a multi-state key is pressed
+    mLastSentStates.erase(inContext);
+  }
 
-  if (!inPayload.contains("settings")) {
+  auto request = PrepareSwitch(inAction, inContext, inPayload);
+  if (!request) {
     return;
   }
 
-  auto& settings = mButtons[inContext].settings;
-  settings = inPayload.at("settings");
+  // Includes settings parsing in PrepareSwitch(), but not the Enqueue()
+  const auto eventThreadAllocations = eventAllocations.Get();
+  mSwitchExecutor.Enqueue(
+    "Switch " + inContext,
+    [this, request = std::move(*request), keyUpAt, eventThreadAllocations]() {
+      mLatencyStats.Record(
+        LatencyStage::SwitchQueueWait,
+        std::chrono::steady_clock::now() - keyUpAt);
+      const ScopedAllocationCount allocations;
+      const auto& action = request.button->action;
+      if (action == MULTI_SET_ACTION_ID) {
+        ExecuteMultiSwitch(request);
+      } else if (action == CYCLE_ACTION_ID) {
+        ExecuteCycleSwitch(request);
+      } else {
+        ExecuteSwitch(request);
+      }
+      mLatencyStats.Record(
+        LatencyStage::KeyUpToSwitched,
+        std::chrono::steady_clock::now() - keyUpAt);
+      if constexpr (ALLOCATION_COUNTING_ENABLED) {
+        const auto switchAllocations = allocations.Get();
+        PluginDebug(
+          "Key press: {} allocations ({} on the event thread, {} switching)",
+          eventThreadAllocations + switchAllocations,
+          eventThreadAllocations,
+          switchAllocations);
+      }
+#ifndef NDEBUG
+      mDeviceCache.GetStateTable().CheckConsistency();
+#endif
+    });
+}
+
+std::optional<AudioSwitcherStreamDeckPlugin::SwitchRequest>
+AudioSwitcherStreamDeckPlugin::PrepareSwitch(
+  const std::string& action,
+  const std::string& context,
+  const json& payload) {
+  if (!payload.contains("settings")) {
+    return {};
+  }
+
+  const auto& settings = payload.at("settings");
+  auto button = mButtons.Get()->Find(context);
+  bool unchanged = false;
+  {
+    const auto timer = mLatencyStats.Measure(LatencyStage::SettingsParse);
+    unchanged
+      = button && button->action == action && HasSettings(*button, settings);
+  }
+  if (!unchanged) {
+    // Everything else is derived from the settings
+    Button changed;
+    changed.action = action;
+    changed.context = context;
+    if (button) {
+      changed.backfilledSettingsHash = button->backfilledSettingsHash;
+    }
+    {
+      const auto timer = mLatencyStats.Measure(LatencyStage::SettingsParse);
+      SetButtonSettings(changed, settings);
+    }
+    {
+      const auto timer = mLatencyStats.Measure(LatencyStage::FillDeviceInfo);
+      FillButtonDeviceInfo(changed);
+    }
+    button = mButtons.Put(std::move(changed));
+  }
 
-  FillButtonDeviceInfo(inContext);
+  return SwitchRequest{
+    .button = std::move(button),
+    .state = EPLJSONUtils::GetIntByName(payload, "state"),
+  };
+}
 
-  const auto state = EPLJSONUtils::GetIntByName(inPayload, "state");
+AudioSwitcherStreamDeckPlugin::ResolvedSwitch
+AudioSwitcherStreamDeckPlugin::ResolveSwitch(const SwitchRequest& request) {
+  const auto& button = *request.button;
+  const auto& action = button.action;
+  const auto& context = button.context;
+  const auto& settings = button.settings;
+  const auto settingsHash = button.settingsHash;
+  const auto state = request.state;
+
+  ResolvedSwitch resolved{
+    // Read first: if anything changes while we're working, this result
+    // must not be used
+    .deviceGeneration = mDeviceGeneration,
+    .action = action,
+    .state = state,
+    .settingsHash = settingsHash,
+  };
 
   // this looks inverted - but if state is 0, we want to move to state 1, so
   // we want the secondary devices. if state is 1, we want state 0, so we want
   // the primary device
-  const auto deviceID = (state != 0 || inAction == SET_ACTION_ID)
-    ? settings.VolatilePrimaryID()
-    : settings.VolatileSecondaryID();
+  {
+    const auto timer = mLatencyStats.Measure(LatencyStage::ResolveDevice);
+    resolved.device = (state != 0 || action == SET_ACTION_ID)
+      ? settings.VolatilePrimaryDevice(mDeviceCache)
+      : settings.VolatileSecondaryDevice(mDeviceCache);
+  }
+  if (resolved.device == NO_DEVICE) {
+    return resolved;
+  }
+
+  {
+    const auto timer = mLatencyStats.Measure(LatencyStage::GetDeviceState);
+    resolved.deviceState = mDeviceCache.GetState(resolved.device);
+  }
+  if (
+    action == SET_ACTION_ID
+    && resolved.deviceState == AudioDeviceState::CONNECTED) {
+    resolved.isAlreadyDefault = resolved.device
+      == mDefaultDevices.Get(settings.direction, settings.role);
+  }
+  return resolved;
+}
 
-  if (deviceID.empty()) {
-    ESDDebug("Doing nothing, no device ID");
+void AudioSwitcherStreamDeckPlugin::ExecuteSwitch(
+  const SwitchRequest& request) {
+  const auto& button = *request.button;
+  const auto& action = button.action;
+  const auto& context = button.context;
+  const auto& settings = button.settings;
+  const auto settingsHash = button.settingsHash;
+  const auto state = request.state;
+
+  ResolvedSwitch resolved;
+  const auto speculative = mSpeculativeSwitches.find(context);
+  if (
+    speculative != mSpeculativeSwitches.end()
+    && speculative->second.deviceGeneration == mDeviceGeneration
+    && speculative->second.action == action
+    && speculative->second.state == state
+    && speculative->second.settingsHash == settingsHash) {
+    resolved = std::move(speculative->second);
+    ++mSpeculativeSwitchHits;
+  } else {
+    resolved = ResolveSwitch(request);
+    ++mSpeculativeSwitchMisses;
+  }
+  if (speculative != mSpeculativeSwitches.end()) {
+    mSpeculativeSwitches.erase(speculative);
+  }
+  PluginDebug(
+    "Speculative resolution: {} hits, {} misses",
+    mSpeculativeSwitchHits,
+    mSpeculativeSwitchMisses);
+
+  if (resolved.device == NO_DEVICE) {
+    PluginDebug("Doing nothing, no device ID");
     return;
   }
 
-  const auto deviceState = GetAudioDeviceState(deviceID);
-  if (deviceState != AudioDeviceState::CONNECTED) {
-    if (inAction == SET_ACTION_ID) {
-      mConnectionManager->SetState(1, inContext);
+  if (resolved.deviceState != AudioDeviceState::CONNECTED) {
+    if (action == SET_ACTION_ID) {
+      SendState(context, 1);
     }
-    mConnectionManager->ShowAlertForContext(inContext);
+    // Not deduplicated: this is direct feedback for a key press
+    mOutboundMessages.ShowAlert(context);
     return;
   }
 
-  if (
-    inAction == SET_ACTION_ID
-    && deviceID == GetDefaultAudioDeviceID(settings.direction, settings.role)) {
+  if (action == SET_ACTION_ID && resolved.isAlreadyDefault) {
     // We already have the correct device, undo the state change
-    mConnectionManager->SetState(state, inContext);
-    ESDDebug("Already set, nothing to do");
+    SendState(context, state);
+    PluginDebug("Already set, nothing to do");
     return;
   }
 
-  ESDDebug("Setting device to {}", deviceID);
-  SetDefaultAudioDeviceID(settings.direction, settings.role, deviceID);
+  const auto direction = settings.direction;
+  const auto role = settings.role;
 
   // Determine which hotkey to use based on which device we're switching to
-  const HotkeyConfig& hotkeyToUse = (state != 0 || inAction == SET_ACTION_ID)
+  const HotkeyConfig& hotkey = (state != 0 || action == SET_ACTION_ID)
     ? settings.primaryHotkey
     : settings.secondaryHotkey;
+  // Empty if the hotkey is disabled
+  const bool hasHotkey = !hotkey.compiled.IsEmpty();
+  if (hasHotkey) {
+    PluginDebug("Queuing hotkey: {}", hotkey.keyCode);
+  }
+  if (hasHotkey && settings.hotkeysWaitForSwitch) {
+    // Queued before switching so that the notification can't be missed
+    mHotkeyDispatcher.Enqueue(
+      hotkey.compiled,
+      HotkeyDispatcher::Confirmation{direction, role, resolved.device});
+  }
+
+  const auto& deviceID = GetDeviceID(resolved.device);
+  PluginDebug("Setting device to {}", deviceID);
+  {
+    std::scoped_lock lock(mPendingSwitchesMutex);
+    mPendingSwitches[{direction, role}]
+      = {resolved.device, std::chrono::steady_clock::now()};
+  }
+  {
+    const auto timer = mLatencyStats.Measure(LatencyStage::SetDefaultDevice);
+    SetDefaultAudioDeviceID(direction, role, deviceID);
+  }
+  mDefaultDevices.Invalidate(direction, role);
+
+  if (hasHotkey && !settings.hotkeysWaitForSwitch) {
+    mHotkeyDispatcher.Enqueue(hotkey.compiled);
+  }
+}
+
+void AudioSwitcherStreamDeckPlugin::ExecuteCycleSwitch(
+  const SwitchRequest& request) {
+  const auto& context = request.button->context;
+  const auto& settings = request.button->settings;
+  const auto direction = settings.direction;
+  const auto role = settings.role;
+
+  auto& cycleOrder = mCycleOrders[context];
+  DeviceHandle device = NO_DEVICE;
+  {
+    const auto timer = mLatencyStats.Measure(LatencyStage::ResolveDevice);
+    const auto current = mDefaultDevices.Get(direction, role);
+    auto snapshot = mDeviceCache.Get(direction);
+    cycleOrder.Update(settings, request.button->settingsHash, *snapshot);
+    device = cycleOrder.GetNext(current);
+
+    // The snapshot is only refreshed on notifications, and not every
+    // platform tells us about devices being removed; check the one device
+    // we're about to use.
+    if (
+      device != NO_DEVICE
+      && mDeviceCache.GetState(device) != AudioDeviceState::CONNECTED) {
+      mDeviceCache.Invalidate(direction);
+      snapshot = mDeviceCache.Get(direction);
+      cycleOrder.Update(settings, request.button->settingsHash, *snapshot);
+      device = cycleOrder.GetNext(current);
+    }
+    if (device == current) {
+      // It's the only connected device in the list
+      device = NO_DEVICE;
+    }
+  }
+
+  if (device == NO_DEVICE) {
+    PluginDebug("No other connected device to cycle to");
+    mOutboundMessages.ShowAlert(context);
+    return;
+  }
 
-  // Trigger hotkey if enabled
-  if (hotkeyToUse.enabled && !hotkeyToUse.keyCode.empty()) {
-    ESDDebug("Triggering hotkey: {}", hotkeyToUse.keyCode);
-    TriggerHotkey(hotkeyToUse);
+  const auto& deviceID = GetDeviceID(device);
+  PluginDebug("Cycling device to {}", deviceID);
+  {
+    std::scoped_lock lock(mPendingSwitchesMutex);
+    mPendingSwitches[{direction, role}]
+      = {device, std::chrono::steady_clock::now()};
   }
+  {
+    const auto timer = mLatencyStats.Measure(LatencyStage::SetDefaultDevice);
+    SetDefaultAudioDeviceID(direction, role, deviceID);
+  }
+  mDefaultDevices.Invalidate(direction, role);
+}
+
+void AudioSwitcherStreamDeckPlugin::ExecuteMultiSwitch(
+  const SwitchRequest& request) {
+  const auto& context = request.button->context;
+  const auto& settings = request.button->settings;
+
+  struct Leg {
+    AudioDeviceDirection direction;
+    AudioDeviceRole role;
+    DeviceHandle device = NO_DEVICE;
+    DeviceHandle previousDevice = NO_DEVICE;
+  };
+  std::vector<Leg> legs;
+
+  // Check everything first, so that in the common failure case (something's
+  // unplugged) we don't change anything
+  for (const auto& target : settings.targets) {
+    const auto device = settings.VolatileTargetDevice(target, mDeviceCache);
+    if (device == NO_DEVICE) {
+      continue;
+    }
+    if (mDeviceCache.GetState(device) != AudioDeviceState::CONNECTED) {
+      PluginDebug(
+        "Not switching anything, {} is not connected", GetDeviceID(device));
+      SendState(context, 1);
+      mOutboundMessages.ShowAlert(context);
+      return;
+    }
+    const auto previousDevice
+      = mDefaultDevices.Get(target.direction, target.role);
+    if (previousDevice == device) {
+      continue;
+    }
+    legs.push_back({target.direction, target.role, device, previousDevice});
+  }
+
+  if (legs.empty()) {
+    PluginDebug("Already set, nothing to do");
+    SendState(context, 0);
+    return;
+  }
+
+  std::vector<std::function<void()>> switches;
+  for (auto& leg : legs) {
+    switches.push_back([this, &leg]() {
+      {
+        std::scoped_lock lock(mPendingSwitchesMutex);
+        mPendingSwitches[{leg.direction, leg.role}]
+          = {leg.device, std::chrono::steady_clock::now()};
+      }
+      const auto timer = mLatencyStats.Measure(LatencyStage::SetDefaultDevice);
+      SetDefaultAudioDeviceID(
+        leg.direction, leg.role, GetDeviceID(leg.device));
+    });
+  }
+  {
+    const auto timer = mLatencyStats.Measure(LatencyStage::MultiSwitch);
+    mFanOutPool.Run(switches);
+  }
+
+  // Asks the audio system, rather than trusting notifications that may not
+  // have arrived yet
+  bool failed = false;
+  for (const auto& leg : legs) {
+    if (mDefaultDevices.Refresh(leg.direction, leg.role) != leg.device) {
+      failed = true;
+    }
+  }
+  if (!failed) {
+    SendState(context, 0);
+    return;
+  }
+
+  ESDLog("Failed to switch all devices for {}, rolling back", context);
+  std::vector<std::function<void()>> rollbacks;
+  for (const auto& leg : legs) {
+    if (leg.previousDevice == NO_DEVICE) {
+      continue;
+    }
+    rollbacks.push_back([this, &leg]() {
+      SetDefaultAudioDeviceID(
+        leg.direction, leg.role, GetDeviceID(leg.previousDevice));
+      mDefaultDevices.Invalidate(leg.direction, leg.role);
+    });
+  }
+  mFanOutPool.Run(rollbacks);
+  SendState(context, 1);
+  mOutboundMessages.ShowAlert(context);
 }
 
 void AudioSwitcherStreamDeckPlugin::WillAppearForAction(
@@ -176,31 +760,96 @@ void AudioSwitcherStreamDeckPlugin::WillAppearForAction(
   const std::string& inContext,
   const json& inPayload,
   const std::string& inDeviceID) {
-  std::scoped_lock lock(mVisibleContextsMutex);
+  const auto eventTimer = mLatencyStats.Measure(LatencyStage::WillAppearEvent);
+  {
+    std::scoped_lock lock(mStatesMutex);
+    if (inPayload.contains("state")) {
+      mLastSentStates[inContext] = inPayload.at("state");
+    } else {
+      mLastSentStates.erase(inContext);
+    }
+  }
+
   // Remember the context
-  mVisibleContexts.insert(inContext);
-  auto& button = mButtons[inContext];
-  button = {inAction, inContext};
+  const auto existing = mButtons.Get()->Find(inContext);
+  Button button = existing ? *existing : Button{};
+  button.action = inAction;
+  button.context = inContext;
 
   if (!inPayload.contains("settings")) {
+    button.settings = {};
+    button.rawSettings = {};
+    button.settingsHash = 0;
+    button.directionsAndRoles = GetDirectionsAndRoles(button);
+    mButtons.Put(std::move(button));
     return;
   }
-  button.settings = inPayload.at("settings");
+  SetButtonSettings(button, inPayload.at("settings"));
+  mButtons.Put(button);
 
-  UpdateState(inContext);
-  FillButtonDeviceInfo(inContext);
+  UpdateState(button);
+  if (FillButtonDeviceInfo(button)) {
+    mButtons.Put(std::move(button));
+  }
 }
 
-void AudioSwitcherStreamDeckPlugin::FillButtonDeviceInfo(
-  const std::string& context) {
-  auto& settings = mButtons.at(context).settings;
+bool AudioSwitcherStreamDeckPlugin::HasSettings(
+  const Button& button,
+  const json& settings) {
+  // Hashing and comparing the JSON is much cheaper than parsing it, and
+  // Stream Deck sends the full settings with every event
+  return std::hash<json>{}(settings) == button.settingsHash
+    && settings == button.rawSettings;
+}
 
-  const auto filledPrimary = FillAudioDeviceInfo(settings.primaryDevice);
-  const auto filledSecondary = FillAudioDeviceInfo(settings.secondaryDevice);
-  if (filledPrimary || filledSecondary) {
-    ESDDebug("Backfilling settings to {}", json(settings).dump());
-    mConnectionManager->SetSettings(settings, context);
+bool AudioSwitcherStreamDeckPlugin::SetButtonSettings(
+  Button& button,
+  const json& settings) {
+  if (HasSettings(button, settings)) {
+    return false;
   }
+
+  button.settings = settings;
+  button.rawSettings = settings;
+  button.settingsHash = std::hash<json>{}(settings);
+  button.directionsAndRoles = GetDirectionsAndRoles(button);
+  return true;
+}
+
+bool AudioSwitcherStreamDeckPlugin::FillButtonDeviceInfo(Button& button) {
+  auto& settings = button.settings;
+
+  const auto filledPrimary
+    = FillAudioDeviceInfo(settings.primaryDevice, mDeviceCache);
+  const auto filledSecondary
+    = FillAudioDeviceInfo(settings.secondaryDevice, mDeviceCache);
+  bool filledTarget = false;
+  for (auto& target : settings.targets) {
+    filledTarget |= FillAudioDeviceInfo(target.device, mDeviceCache);
+  }
+  for (auto& device : settings.cycleDevices) {
+    if (device.direction != settings.direction) {
+      // Only the ID is set if the settings are from an older version
+      device.direction = settings.direction;
+    }
+    filledTarget |= FillAudioDeviceInfo(device, mDeviceCache);
+  }
+  if (!(filledPrimary || filledSecondary || filledTarget)) {
+    return false;
+  }
+
+  // Stream Deck echoes the backfill back as DidReceiveSettings; keep what we
+  // sent as the raw settings so that it's recognized as unchanged
+  json filled = settings;
+  const auto hash = std::hash<json>{}(filled);
+  if (hash != button.backfilledSettingsHash) {
+    PluginDebug("Backfilling settings to {}", LogJSON{filled});
+    mOutboundMessages.SetSettings(button.context, filled);
+    button.backfilledSettingsHash = hash;
+  }
+  button.rawSettings = std::move(filled);
+  button.settingsHash = hash;
+  return true;
 }
 
 void AudioSwitcherStreamDeckPlugin::WillDisappearForAction(
@@ -208,10 +857,19 @@ void AudioSwitcherStreamDeckPlugin::WillDisappearForAction(
   const std::string& inContext,
   const json& inPayload,
   const std::string& inDeviceID) {
+  const auto eventTimer
+    = mLatencyStats.Measure(LatencyStage::WillDisappearEvent);
   // Remove the context
-  std::scoped_lock lock(mVisibleContextsMutex);
-  mVisibleContexts.erase(inContext);
-  mButtons.erase(inContext);
+  {
+    std::scoped_lock lock(mStatesMutex);
+    mLastSentStates.erase(inContext);
+  }
+  mButtons.Remove(inContext);
+  mSwitchExecutor.Enqueue("Forget button", [this, context = inContext]() {
+    mCycleOrders.erase(context);
+    mSpeculativeSwitches.erase(context);
+    mDeviceListSubscribers.erase(context);
+  });
 }
 
 void AudioSwitcherStreamDeckPlugin::SendToPlugin(
@@ -219,67 +877,171 @@ void AudioSwitcherStreamDeckPlugin::SendToPlugin(
   const std::string& inContext,
   const json& inPayload,
   const std::string& inDeviceID) {
-  json outPayload;
-
+  const auto eventTimer
+    = mLatencyStats.Measure(LatencyStage::SendToPluginEvent);
   const auto event = EPLJSONUtils::GetStringByName(inPayload, "event");
-  ESDDebug("Received event {}", event);
+  PluginDebug("Received event {}", event);
+
+  // Publishing may enumerate devices, so is only done on the executor, never
+  // on the Stream Deck event thread
+  if (event == "subscribeDeviceList") {
+    mSwitchExecutor.Enqueue(
+      "Subscribe to device lists",
+      [this, action = inAction, context = inContext]() {
+        // Bring the published lists up to date, so the full list we send now
+        // is the base for the next delta
+        PublishDeviceListChanges();
+        mDeviceListSubscribers.insert_or_assign(context, action);
+
+        const json message{
+          {"event", "deviceList"},
+          {"generation", mDeviceListGeneration},
+          {"outputDevices",
+           mPublishedDeviceLists.at(AudioDeviceDirection::OUTPUT)->devices},
+          {"inputDevices",
+           mPublishedDeviceLists.at(AudioDeviceDirection::INPUT)->devices},
+        };
+        PluginDebug(
+          "Sending device list generation {} ({} bytes)",
+          mDeviceListGeneration,
+          message.dump().size());
+        mConnectionManager->SendToPropertyInspector(action, context, message);
+
+        // Sent from the cache so the property inspector opens quickly, but
+        // the user's looking at the list, so make sure it's up to date. This
+        // also refreshes the snapshot used by the buttons.
+        mDeviceCache.Refresh(AudioDeviceDirection::OUTPUT);
+        mDeviceCache.Refresh(AudioDeviceDirection::INPUT);
+        PublishDeviceListChanges();
+      });
+    return;
+  }
+
+  if (event == "unsubscribeDeviceList") {
+    mSwitchExecutor.Enqueue(
+      "Unsubscribe from device lists", [this, context = inContext]() {
+        mDeviceListSubscribers.erase(context);
+      });
+    return;
+  }
 
-  if (event == "getDeviceList") {
-    const auto outputList = GetAudioDeviceList(AudioDeviceDirection::OUTPUT);
-    const auto inputList = GetAudioDeviceList(AudioDeviceDirection::INPUT);
+  if (event == "getLatencyStats") {
+    auto stats = mLatencyStats.ToJSON();
+    stats["outboundMessages"] = mOutboundMessages.GetMetrics();
+    ESDLog("Latency stats: {}", stats.dump());
     mConnectionManager->SendToPropertyInspector(
       inAction,
       inContext,
       json({
         {"event", event},
-        {"outputDevices", outputList},
-        {"inputDevices", inputList},
+        {"stats", stats},
       }));
     return;
   }
+
+  if (event == "setDebugLogging") {
+    const auto enabled = EPLJSONUtils::GetBoolByName(inPayload, "enabled");
+    ESDLog("Debug logging {}", enabled ? "enabled" : "disabled");
+    DebugLog::SetEnabled(enabled);
+    return;
+  }
 }
 
 void AudioSwitcherStreamDeckPlugin::UpdateState(
-  const std::string& context,
-  const std::string& optionalDefaultDevice) {
-  const auto button = mButtons[context];
-  const auto action = button.action;
-  const auto settings = button.settings;
-  const auto activeDevice = optionalDefaultDevice.empty()
-    ? GetDefaultAudioDeviceID(settings.direction, settings.role)
+  const Button& button,
+  DeviceHandle optionalDefaultDevice) {
+  const auto& context = button.context;
+  const auto& action = button.action;
+  const auto& settings = button.settings;
+
+  if (action == CYCLE_ACTION_ID) {
+    // Only has one state
+    return;
+  }
+
+  if (action == MULTI_SET_ACTION_ID) {
+    // Active if every target is the current default
+    bool active = !settings.targets.empty();
+    for (const auto& target : settings.targets) {
+      const auto device = settings.VolatileTargetDevice(target, mDeviceCache);
+      if (
+        device == NO_DEVICE
+        || device != mDefaultDevices.Get(target.direction, target.role)) {
+        active = false;
+        break;
+      }
+    }
+    SendState(context, active ? 0 : 1);
+    return;
+  }
+
+  const auto activeDevice = (optionalDefaultDevice == NO_DEVICE)
+    ? mDefaultDevices.Get(settings.direction, settings.role)
     : optionalDefaultDevice;
 
-  const auto primaryID = settings.VolatilePrimaryID();
-  const auto secondaryID = settings.VolatileSecondaryID();
+  const auto primary = settings.VolatilePrimaryDevice(mDeviceCache);
+  const auto secondary = settings.VolatileSecondaryDevice(mDeviceCache);
 
-  std::scoped_lock lock(mVisibleContextsMutex);
   if (action == SET_ACTION_ID) {
-    mConnectionManager->SetState(activeDevice == primaryID ? 0 : 1, context);
+    SendState(context, activeDevice == primary ? 0 : 1);
     return;
   }
 
-  if (activeDevice == primaryID) {
-    mConnectionManager->SetState(0, context);
+  if (activeDevice == primary) {
+    SendState(context, 0);
     return;
   }
 
-  if (activeDevice == secondaryID) {
-    mConnectionManager->SetState(1, context);
+  if (activeDevice == secondary) {
+    SendState(context, 1);
     return;
   }
 
-  mConnectionManager->ShowAlertForContext(context);
+  SendState(context, ALERT_STATE);
+}
+
+void AudioSwitcherStreamDeckPlugin::SendState(
+  const std::string& context,
+  int state) {
+  std::scoped_lock lock(mStatesMutex);
+  // Before deduplicating: Stream Deck may have reported this state when the
+  // button appeared, but we've still only now worked out what to show
+  if (!mShownFirstState) {
+    mShownFirstState = true;
+    const auto elapsed = std::chrono::steady_clock::now() - mStartedAt;
+    mLatencyStats.Record(LatencyStage::StartupToFirstState, elapsed);
+    ESDLog(
+      "First button state {}ms after startup", ElapsedMilliseconds(elapsed));
+  }
+
+  const auto [it, inserted] = mLastSentStates.try_emplace(context, state);
+  if (!inserted) {
+    if (it->second == state) {
+      ++mSkippedStateMessages;
+      return;
+    }
+    it->second = state;
+  }
+
+  if (state == ALERT_STATE) {
+    mOutboundMessages.ShowAlert(context);
+    return;
+  }
+  mOutboundMessages.SetState(context, state);
 }
 
 void AudioSwitcherStreamDeckPlugin::DeviceDidConnect(
   const std::string& inDeviceID,
   const json& inDeviceInfo) {
-  // Nothing to do
+  // A reconnected deck may not be showing what we last sent
+  std::scoped_lock lock(mStatesMutex);
+  mLastSentStates.clear();
 }
 
 void AudioSwitcherStreamDeckPlugin::DeviceDidDisconnect(
   const std::string& inDeviceID) {
-  // Nothing to do
+  std::scoped_lock lock(mStatesMutex);
+  mLastSentStates.clear();
 }
 
 void AudioSwitcherStreamDeckPlugin::DidReceiveGlobalSettings(
@@ -291,277 +1053,19 @@ void AudioSwitcherStreamDeckPlugin::DidReceiveSettings(
   const std::string& inContext,
   const json& inPayload,
   const std::string& inDeviceID) {
-  WillAppearForAction(inAction, inContext, inPayload, inDeviceID);
-}
-
-// Add the TriggerHotkey function
-void TriggerHotkey(const HotkeyConfig& hotkey) {
-  if (!hotkey.enabled || hotkey.keyCode.empty()) {
-    return;
-  }
-
-#ifdef _WIN32
-  INPUT inputs[10] = {};// Maximum 5 keys (4 modifiers + 1 key) plus releases
-  int inputCount = 0;
-
-  // Press modifiers
-  if (hotkey.ctrl) {
-    inputs[inputCount].type = INPUT_KEYBOARD;
-    inputs[inputCount].ki.wVk = VK_CONTROL;
-    inputCount++;
-  }
-  if (hotkey.alt) {
-    inputs[inputCount].type = INPUT_KEYBOARD;
-    inputs[inputCount].ki.wVk = VK_MENU;
-    inputCount++;
-  }
-  if (hotkey.shift) {
-    inputs[inputCount].type = INPUT_KEYBOARD;
-    inputs[inputCount].ki.wVk = VK_SHIFT;
-    inputCount++;
-  }
-  if (hotkey.win) {
-    inputs[inputCount].type = INPUT_KEYBOARD;
-    inputs[inputCount].ki.wVk = VK_LWIN;
-    inputCount++;
-  }
-
-  // Press the key
-  inputs[inputCount].type = INPUT_KEYBOARD;
-  // Convert string key code to virtual key code
-  WORD vkCode = 0;
-
-  if (hotkey.keyCode.length() == 1) {
-    // Convert single character to virtual key code
-    SHORT scanCode = VkKeyScanA(hotkey.keyCode[0]);
-    if (scanCode != -1) {
-      vkCode = LOBYTE(scanCode);
-    }
-  } else if (
-    hotkey.keyCode.substr(0, 1) == "F" && hotkey.keyCode.length() <= 3) {
-    // Handle function keys F1-F24
-    try {
-      int fKey = std::stoi(hotkey.keyCode.substr(1));
-      if (fKey >= 1 && fKey <= 24) {
-        vkCode = VK_F1 + (fKey - 1);
-      }
-    } catch (const std::exception& e) {
-      // Error parsing function key
-    }
-  } else {
-    // Handle named keys using a switch for cleaner code
-    // First check for special key names
-    if (hotkey.keyCode == "SPACE") {
-      vkCode = VK_SPACE;
-    } else if (hotkey.keyCode == "ENTER" || hotkey.keyCode == "RETURN") {
-      vkCode = VK_RETURN;
-    } else if (hotkey.keyCode == "ESCAPE" || hotkey.keyCode == "ESC") {
-      vkCode = VK_ESCAPE;
-    } else if (hotkey.keyCode == "TAB") {
-      vkCode = VK_TAB;
-    } else {
-      // For single letters and numbers, use a switch statement
-      if (hotkey.keyCode.length() == 1) {
-        char key = hotkey.keyCode[0];
-        vkCode = key;// ASCII values map directly to VK codes for A-Z and 0-9
-      } else {
-        // For named letter keys (e.g., "A", "B")
-        switch (hotkey.keyCode[0]) {
-          case 'A':
-            vkCode = 'A';
-            break;
-          case 'B':
-            vkCode = 'B';
-            break;
-          case 'C':
-            vkCode = 'C';
-            break;
-          case 'D':
-            vkCode = 'D';
-            break;
-          case 'E':
-            vkCode = 'E';
-            break;
-          case 'F':
-            vkCode = 'F';
-            break;
-          case 'G':
-            vkCode = 'G';
-            break;
-          case 'H':
-            vkCode = 'H';
-            break;
-          case 'I':
-            vkCode = 'I';
-            break;
-          case 'J':
-            vkCode = 'J';
-            break;
-          case 'K':
-            vkCode = 'K';
-            break;
-          case 'L':
-            vkCode = 'L';
-            break;
-          case 'M':
-            vkCode = 'M';
-            break;
-          case 'N':
-            vkCode = 'N';
-            break;
-          case 'O':
-            vkCode = 'O';
-            break;
-          case 'P':
-            vkCode = 'P';
-            break;
-          case 'Q':
-            vkCode = 'Q';
-            break;
-          case 'R':
-            vkCode = 'R';
-            break;
-          case 'S':
-            vkCode = 'S';
-            break;
-          case 'T':
-            vkCode = 'T';
-            break;
-          case 'U':
-            vkCode = 'U';
-            break;
-          case 'V':
-            vkCode = 'V';
-            break;
-          case 'W':
-            vkCode = 'W';
-            break;
-          case 'X':
-            vkCode = 'X';
-            break;
-          case 'Y':
-            vkCode = 'Y';
-            break;
-          case 'Z':
-            vkCode = 'Z';
-            break;
-          case '0':
-            vkCode = '0';
-            break;
-          case '1':
-            vkCode = '1';
-            break;
-          case '2':
-            vkCode = '2';
-            break;
-          case '3':
-            vkCode = '3';
-            break;
-          case '4':
-            vkCode = '4';
-            break;
-          case '5':
-            vkCode = '5';
-            break;
-          case '6':
-            vkCode = '6';
-            break;
-          case '7':
-            vkCode = '7';
-            break;
-          case '8':
-            vkCode = '8';
-            break;
-          case '9':
-            vkCode = '9';
-            break;
-          default:
-            break;// Key not recognized
-        }
-      }
-    }
-  }
-
-  if (vkCode != 0) {
-    inputs[inputCount].ki.wVk = LOBYTE(vkCode);
-    inputCount++;
-
-    // Now set up the key releases (in reverse order)
-    // First, release the key
-    inputs[inputCount] = inputs[inputCount - 1];
-    inputs[inputCount].ki.dwFlags = KEYEVENTF_KEYUP;
-    inputCount++;
-
-    // Then release modifiers in reverse order
-    for (int i = inputCount - 3; i >= 0; i--) {
-      inputs[inputCount] = inputs[i];
-      inputs[inputCount].ki.dwFlags = KEYEVENTF_KEYUP;
-      inputCount++;
-    }
-
-    // Send key events
-    UINT result = SendInput(inputCount, inputs, sizeof(INPUT));
-    if (result != inputCount) {
-      DWORD errorCode = GetLastError();
-      ESDDebug("SendInput failed with error: {}", errorCode);
-    }
-  }
-
-#elif defined(__APPLE__)
-  // macOS implementation using CGEventCreateKeyboardEvent
-  CGEventSourceRef source
-    = CGEventSourceCreate(kCGEventSourceStateHIDSystemState);
-
-  // Get the key code for the specified key
-  CGKeyCode keyCode = 0;
-  // Basic mapping for common keys
-  if (hotkey.keyCode.length() == 1) {
-    char key = hotkey.keyCode[0];
-    if (key >= 'A' && key <= 'Z') {
-      // Map A-Z to macOS virtual key codes
-      keyCode = 0x00 + (key - 'A');// 'A' is 0x00, 'B' is 0x0B, etc.
-    }
-  } else if (
-    hotkey.keyCode.substr(0, 1) == "F" && hotkey.keyCode.length() <= 3) {
-    // Handle function keys F1-F12
-    int fKey = std::stoi(hotkey.keyCode.substr(1));
-    if (fKey >= 1 && fKey <= 12) {
-      static const CGKeyCode fKeyCodes[12] = {
-        0x7A, 0x78, 0x63, 0x76, 0x60, 0x61, 0x62, 0x64, 0x65, 0x6D, 0x67, 0x6F};
-      keyCode = fKeyCodes[fKey - 1];
+  // Skip the echo of our own backfill: the button already has these
+  // settings, and handling it would parse and fill them all over again
+  const auto existing = mButtons.Get()->Find(inContext);
+  if (
+    existing && existing->backfilledSettingsHash
+    && inPayload.contains("settings")) {
+    const auto& settings = inPayload.at("settings");
+    if (
+      std::hash<json>{}(settings) == existing->backfilledSettingsHash
+      && settings == existing->rawSettings) {
+      PluginDebug("Skipping echo of backfilled settings for {}", inContext);
+      return;
     }
   }
-
-  if (keyCode != 0) {
-    // Create key down event
-    CGEventRef keyDownEvent = CGEventCreateKeyboardEvent(source, keyCode, true);
-
-    // Set modifiers
-    CGEventFlags flags = 0;
-    if (hotkey.ctrl)
-      flags |= kCGEventFlagMaskControl;
-    if (hotkey.alt)
-      flags |= kCGEventFlagMaskAlternate;
-    if (hotkey.shift)
-      flags |= kCGEventFlagMaskShift;
-    if (hotkey.win)
-      flags |= kCGEventFlagMaskCommand;
-
-    CGEventSetFlags(keyDownEvent, flags);
-
-    // Create key up event
-    CGEventRef keyUpEvent = CGEventCreateKeyboardEvent(source, keyCode, false);
-    CGEventSetFlags(keyUpEvent, flags);
-
-    // Post events
-    CGEventPost(kCGHIDEventTap, keyDownEvent);
-    usleep(10000);// Small delay
-    CGEventPost(kCGHIDEventTap, keyUpEvent);
-
-    // Release resources
-    CFRelease(keyDownEvent);
-    CFRelease(keyUpEvent);
-    CFRelease(source);
-  }
-#endif
+  WillAppearForAction(inAction, inContext, inPayload, inDeviceID);
 }
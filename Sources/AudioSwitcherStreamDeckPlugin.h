@@ -13,10 +13,27 @@ LICENSE file.
 #include <AudioDevices/AudioDevices.h>
 #include <StreamDeckSDK/ESDBasePlugin.h>
 
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
 #include <mutex>
-#include <set>
+#include <optional>
+#include <utility>
+#include <vector>
 
+#include "AudioDeviceCache.h"
+#include "ButtonRegistry.h"
 #include "ButtonSettings.h"
+#include "CycleOrder.h"
+#include "DefaultDeviceChangeCoalescer.h"
+#include "DefaultDeviceTable.h"
+#include "DeviceIDTable.h"
+#include "FanOutPool.h"
+#include "HotkeyDispatcher.h"
+#include "LatencyStats.h"
+#include "OutboundMessageQueue.h"
+#include "SwitchExecutor.h"
 
 using json = nlohmann::json;
 using namespace FredEmmott::Audio;
@@ -25,7 +42,10 @@ class CallBackTimer;
 
 class AudioSwitcherStreamDeckPlugin : public ESDBasePlugin {
  public:
-  AudioSwitcherStreamDeckPlugin();
+  // Messages for buttons go to Stream Deck, unless there's a sink, e.g. in
+  // tests
+  explicit AudioSwitcherStreamDeckPlugin(
+    std::unique_ptr<OutboundMessageSink> = {});
   virtual ~AudioSwitcherStreamDeckPlugin();
 
   void KeyDownForAction(
@@ -68,25 +88,127 @@ class AudioSwitcherStreamDeckPlugin : public ESDBasePlugin {
     const std::string& inDeviceID) override;
 
  private:
-  struct Button {
-    std::string action;
-    std::string context;
-    ButtonSettings settings;
+  // Everything needed to switch device after the key handler returns
+  struct SwitchRequest {
+    // As stored in mButtons; shared rather than copied, as it's immutable
+    std::shared_ptr<const Button> button;
+    int state;
   };
 
-  std::recursive_mutex mVisibleContextsMutex;
-  std::set<std::string> mVisibleContexts;
+  // The slow, device-dependent part of a switch; this can be worked out on
+  // key-down, and used on key-up if nothing has changed since.
+  struct ResolvedSwitch {
+    uint64_t deviceGeneration = 0;
+    std::string action;
+    int state = 0;
+    std::size_t settingsHash = 0;
+
+    DeviceHandle device = NO_DEVICE;
+    AudioDeviceState deviceState = AudioDeviceState::DEVICE_NOT_PRESENT;
+    bool isAlreadyDefault = false;
+  };
 
-  std::map<std::string, Button> mButtons;
+  // Only changed by Stream Deck event handlers, which are all called on the
+  // same thread, so they can read a button, change it, then put it back.
+  ButtonRegistry mButtons;
+  AudioDeviceCache mDeviceCache;
   DefaultChangeCallbackHandle mCallbackHandle;
 
+  // Replaces the device lists loaded from disk with live ones
+  void ReconcileDeviceCache();
   void OnDefaultDeviceChanged(
     AudioDeviceDirection direction,
     AudioDeviceRole role,
     const std::string& activeAudioDeviceID);
-  void UpdateState(const std::string& context, const std::string& device = "");
-  void FillButtonDeviceInfo(const std::string& context);
+  // Device added, removed, or state changed; NO_DEVICE if any may have
+  void OnDeviceStateChanged(DeviceHandle);
+  // Enumerates both directions on mSwitchExecutor, then publishes any
+  // changes to property inspectors
+  void QueueDeviceListRefresh();
+  void OnDefaultDeviceChangesCoalesced(
+    const DefaultDeviceChangeCoalescer::Changes&);
+  // Sends any changes to the device lists since the last call to subscribed
+  // property inspectors. Only call on mSwitchExecutor's thread: if a list
+  // has been invalidated, this enumerates.
+  void PublishDeviceListChanges();
+  void UpdateState(const Button&, DeviceHandle defaultDevice = NO_DEVICE);
+  // Does nothing if the button is already in this state
+  void SendState(const std::string& context, int state);
+  // Returns true if the button was last given these settings
+  static bool HasSettings(const Button& button, const json& settings);
+  // Returns false if the settings haven't changed
+  bool SetButtonSettings(Button& button, const json& settings);
+  // Returns false if nothing was filled in
+  bool FillButtonDeviceInfo(Button& button);
+  std::optional<SwitchRequest> PrepareSwitch(
+    const std::string& action,
+    const std::string& context,
+    const json& payload);
+  ResolvedSwitch ResolveSwitch(const SwitchRequest&);
+  void ExecuteSwitch(const SwitchRequest&);
+  void ExecuteMultiSwitch(const SwitchRequest&);
+  void ExecuteCycleSwitch(const SwitchRequest&);
+  static std::vector<std::pair<AudioDeviceDirection, AudioDeviceRole>>
+  GetDirectionsAndRoles(const Button&);
+
+  // Held while queuing a state, so that states for a context can't be
+  // reordered after deduplication
+  std::mutex mStatesMutex;
+  // Last state sent to (or reported by) Stream Deck, by context; guarded by
+  // mStatesMutex
+  std::map<std::string, int> mLastSentStates;
+
+  LatencyStats mLatencyStats;
+  // Switches we're waiting to be notified about, for timing
+  struct PendingSwitch {
+    DeviceHandle device = NO_DEVICE;
+    std::chrono::steady_clock::time_point startedAt;
+  };
+  std::mutex mPendingSwitchesMutex;
+  std::map<std::pair<AudioDeviceDirection, AudioDeviceRole>, PendingSwitch>
+    mPendingSwitches;
+
+  DefaultDeviceTable mDefaultDevices;
+  // Incremented on every default device or device state change
+  std::atomic<uint64_t> mDeviceGeneration{0};
+  // Set while QueueDeviceListRefresh()'s task is queued
+  std::atomic<bool> mDeviceListRefreshPending{false};
+  // Only accessed from mSwitchExecutor's thread
+  std::map<std::string, ResolvedSwitch> mSpeculativeSwitches;
+  uint64_t mSpeculativeSwitchHits = 0;
+  uint64_t mSpeculativeSwitchMisses = 0;
+  // By context; only accessed from mSwitchExecutor's thread
+  std::map<std::string, CycleOrder> mCycleOrders;
+
+  std::atomic<uint64_t> mSuppressedStateUpdates{0};
+  std::atomic<uint64_t> mSkippedStateMessages{0};
+
+  // Property inspectors that want device list updates; action by context.
+  // Only accessed from mSwitchExecutor's thread, as are the next two.
+  std::map<std::string, std::string> mDeviceListSubscribers;
+  // Incremented each time the published lists change
+  uint64_t mDeviceListGeneration = 0;
+  // What subscribers have been sent
+  std::map<AudioDeviceDirection, std::shared_ptr<const AudioDeviceSnapshot>>
+    mPublishedDeviceLists;
+
+  const std::chrono::steady_clock::time_point mStartedAt
+    = std::chrono::steady_clock::now();
+  // Guarded by mStatesMutex
+  bool mShownFirstState = false;
+
+  // Last, so these are stopped before anything they use is destroyed.
+  // The others queue hotkeys and messages, and mDefaultDeviceChangeCoalescer
+  // can queue saving the device lists on mSwitchExecutor, so that must stop
+  // first, then mSwitchExecutor, and mOutboundMessages last.
+  OutboundMessageQueue mOutboundMessages;
+  // Used by mSwitchExecutor's tasks to make a 'set multiple devices' press's
+  // changes at once; there are at most 4, one per direction and role, and
+  // the executor's thread makes one of them.
+  FanOutPool mFanOutPool{3};
+  HotkeyDispatcher mHotkeyDispatcher{
+    std::make_unique<NativeHotkeySink>(),
+    mLatencyStats};
+  SwitchExecutor mSwitchExecutor;
+  DefaultDeviceChangeCoalescer mDefaultDeviceChangeCoalescer;
 };
-
-// Function to trigger hotkeys with the given configuration
-void TriggerHotkey(const HotkeyConfig& hotkey);
@@ -0,0 +1,103 @@
+/* Copyright (c) 2018-present, Fred Emmott
+ *
+ * This source code is licensed under the MIT-style license found in the
+ * LICENSE file.
+ */
+
+#include "ButtonRegistry.h"
+
+#include <algorithm>
+
+std::shared_ptr<const Button> ButtonRegistry::Snapshot::Find(
+  const std::string& context) const {
+  const auto it = buttons.find(context);
+  if (it == buttons.end()) {
+    return nullptr;
+  }
+  return it->second;
+}
+
+ButtonRegistry::ButtonRegistry() : mSnapshot(std::make_shared<Snapshot>()) {
+}
+
+std::shared_ptr<const ButtonRegistry::Snapshot> ButtonRegistry::Get() const {
+  std::scoped_lock lock(mSnapshotMutex);
+  return mSnapshot;
+}
+
+std::shared_ptr<const Button> ButtonRegistry::Put(Button button) {
+  std::scoped_lock lock(mWriterMutex);
+  auto next = std::make_shared<Snapshot>(*Get());
+  auto stored = std::make_shared<const Button>(std::move(button));
+  const auto previous = std::exchange(next->buttons[stored->context], stored);
+  Reindex(*next, previous, stored);
+  Publish(std::move(next));
+  return stored;
+}
+
+void ButtonRegistry::Remove(const std::string& context) {
+  std::scoped_lock lock(mWriterMutex);
+  const auto current = Get();
+  const auto it = current->buttons.find(context);
+  if (it == current->buttons.end()) {
+    return;
+  }
+  const auto removed = it->second;
+  auto next = std::make_shared<Snapshot>(*current);
+  next->buttons.erase(context);
+  Reindex(*next, removed, nullptr);
+  Publish(std::move(next));
+}
+
+void ButtonRegistry::Reindex(
+  Snapshot& snapshot,
+  const std::shared_ptr<const Button>& removed,
+  const std::shared_ptr<const Button>& added) {
+  std::vector<DirectionAndRole> keys;
+  for (const auto& button : {removed, added}) {
+    if (!button) {
+      continue;
+    }
+    for (const auto& key : button->directionsAndRoles) {
+      if (std::ranges::find(keys, key) == keys.end()) {
+        keys.push_back(key);
+      }
+    }
+  }
+
+  auto& index = snapshot.buttonsByDirectionAndRole;
+  for (const auto& key : keys) {
+    const auto it = index.find(key);
+    auto buttons = (it == index.end()) ? std::make_shared<Buttons>()
+                                       : std::make_shared<Buttons>(*it->second);
+    // Replace in place, so that the order doesn't change with every update
+    auto pos = std::ranges::find(*buttons, removed);
+    if (pos != buttons->end()) {
+      pos = buttons->erase(pos);
+    }
+    if (
+      added
+      && std::ranges::find(added->directionsAndRoles, key)
+        != added->directionsAndRoles.end()) {
+      buttons->insert(pos, added);
+    }
+
+    if (buttons->empty()) {
+      if (it != index.end()) {
+        index.erase(it);
+      }
+    } else {
+      index.insert_or_assign(key, std::move(buttons));
+    }
+  }
+}
+
+void ButtonRegistry::Publish(std::shared_ptr<Snapshot> next) {
+  std::shared_ptr<const Snapshot> previous;
+  {
+    std::scoped_lock lock(mSnapshotMutex);
+    previous = std::exchange(mSnapshot, std::move(next));
+  }
+  // `previous` is released here, outside the lock; if it was the last
+  // reference, destroying it doesn't block readers.
+}
@@ -0,0 +1,85 @@
+/* Copyright (c) 2018-present, Fred Emmott
+ *
+ * This source code is licensed under the MIT-style license found in the
+ * LICENSE file.
+ */
+#pragma once
+
+#include <AudioDevices/AudioDevices.h>
+
+#include <nlohmann/json.hpp>
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "ButtonSettings.h"
+
+using namespace FredEmmott::Audio;
+
+struct Button {
+  std::string action;
+  std::string context;
+  ButtonSettings settings;
+  // The JSON `settings` was parsed from
+  nlohmann::json rawSettings;
+  std::size_t settingsHash = 0;
+  // Hash of the settings we last backfilled to Stream Deck; 0 if none
+  std::size_t backfilledSettingsHash = 0;
+  // The defaults this button's state depends on
+  std::vector<std::pair<AudioDeviceDirection, AudioDeviceRole>>
+    directionsAndRoles;
+};
+
+// The visible buttons.
+//
+// Buttons are read far more often than they change - every default device
+// notification reads them, but only Stream Deck events change them - so
+// readers get an immutable snapshot and never wait for a writer. Writers
+// copy the current snapshot, change the copy, then swap it in.
+//
+// The lists in the direction and role index are shared between snapshots,
+// so a change only copies the lists for the directions and roles of the
+// button it adds or removes, rather than rebuilding the index.
+class ButtonRegistry {
+ public:
+  using Buttons = std::vector<std::shared_ptr<const Button>>;
+  using DirectionAndRole = std::pair<AudioDeviceDirection, AudioDeviceRole>;
+
+  struct Snapshot {
+    std::map<std::string, std::shared_ptr<const Button>> buttons;
+    // Lists are never empty
+    std::map<DirectionAndRole, std::shared_ptr<const Buttons>>
+      buttonsByDirectionAndRole;
+
+    // Returns nullptr if there's no button for this context
+    std::shared_ptr<const Button> Find(const std::string& context) const;
+  };
+
+  ButtonRegistry();
+
+  std::shared_ptr<const Snapshot> Get() const;
+
+  // Adds or replaces the button with the same context; returns the button as
+  // stored
+  std::shared_ptr<const Button> Put(Button);
+  void Remove(const std::string& context);
+
+ private:
+  // Replaces `removed` with `added` in the index; either may be nullptr
+  static void Reindex(
+    Snapshot&,
+    const std::shared_ptr<const Button>& removed,
+    const std::shared_ptr<const Button>& added);
+  void Publish(std::shared_ptr<Snapshot>);
+
+  // Serializes writers, so that none of them lose another's change
+  std::mutex mWriterMutex;
+  // Only held while copying or replacing mSnapshot. Not
+  // std::atomic<std::shared_ptr>, as Apple's libc++ doesn't have it.
+  mutable std::mutex mSnapshotMutex;
+  std::shared_ptr<const Snapshot> mSnapshot;
+};
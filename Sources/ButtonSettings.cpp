@@ -6,11 +6,10 @@
 
 #include "ButtonSettings.h"
 
-#include <StreamDeckSDK/ESDLogger.h>
-
-#include <regex>
-
+#include "AudioDeviceCache.h"
+#include "audio_binary.h"
 #include "audio_json.h"
+#include "DebugLog.h"
 
 // Forward declaration of FileLog for consistency with
 // AudioSwitcherStreamDeckPlugin.cpp
@@ -69,6 +68,8 @@ void from_json(const nlohmann::json& j, HotkeyConfig& hk) {
     // For backward compatibility
     hk.keyCode = j.at("hotkeyKey");
   }
+
+  hk.compiled = CompileHotkey(hk);
 }
 
 void to_json(nlohmann::json& j, const HotkeyConfig& hk) {
@@ -81,8 +82,53 @@ void to_json(nlohmann::json& j, const HotkeyConfig& hk) {
     {"keyCode", hk.keyCode}};
 }
 
+void from_json(const nlohmann::json& j, SwitchTarget& target) {
+  if (j.contains("direction")) {
+    target.direction = j.at("direction");
+  }
+  if (j.contains("role")) {
+    target.role = j.at("role");
+  }
+  if (j.contains("device")) {
+    const auto& device = j.at("device");
+    if (device.is_string()) {
+      target.device.id = device;
+      target.device.direction = target.direction;
+    } else {
+      target.device = device;
+    }
+  }
+}
+
+void to_json(nlohmann::json& j, const SwitchTarget& target) {
+  j = {
+    {"direction", target.direction},
+    {"role", target.role},
+    {"device", target.device}};
+}
+
 void from_json(const nlohmann::json& j, ButtonSettings& bs) {
+  if (j.contains("targets")) {
+    bs.targets = j.at("targets").get<std::vector<SwitchTarget>>();
+  }
+
+  if (j.contains("cycleDevices")) {
+    bs.cycleDevices.clear();
+    for (const auto& device : j.at("cycleDevices")) {
+      if (device.is_string()) {
+        bs.cycleDevices.push_back({.id = device.get<std::string>()});
+      } else {
+        bs.cycleDevices.push_back(device.get<AudioDeviceInfo>());
+      }
+    }
+  }
+
+  if (j.contains("matchStrategy")) {
+    bs.matchStrategy = j.at("matchStrategy");
+  }
+
   if (!j.contains("direction")) {
+    bs.InternDeviceIDs();
     return;
   }
 
@@ -110,10 +156,6 @@ void from_json(const nlohmann::json& j, ButtonSettings& bs) {
     }
   }
 
-  if (j.contains("matchStrategy")) {
-    bs.matchStrategy = j.at("matchStrategy");
-  }
-
   if (j.contains("primaryHotkey")) {
     bs.primaryHotkey = j.at("primaryHotkey");
   } else if (j.contains("hotkey")) {
@@ -124,6 +166,12 @@ void from_json(const nlohmann::json& j, ButtonSettings& bs) {
   if (j.contains("secondaryHotkey")) {
     bs.secondaryHotkey = j.at("secondaryHotkey");
   }
+
+  if (j.contains("hotkeysWaitForSwitch")) {
+    bs.hotkeysWaitForSwitch = j.at("hotkeysWaitForSwitch");
+  }
+
+  bs.InternDeviceIDs();
 }
 
 void to_json(nlohmann::json& j, const ButtonSettings& bs) {
@@ -134,68 +182,332 @@ void to_json(nlohmann::json& j, const ButtonSettings& bs) {
     {"secondary", bs.secondaryDevice},
     {"matchStrategy", bs.matchStrategy},
     {"primaryHotkey", bs.primaryHotkey},
-    {"secondaryHotkey", bs.secondaryHotkey}};
+    {"secondaryHotkey", bs.secondaryHotkey},
+    {"hotkeysWaitForSwitch", bs.hotkeysWaitForSwitch}};
+  if (!bs.targets.empty()) {
+    j["targets"] = bs.targets;
+  }
+  if (!bs.cycleDevices.empty()) {
+    j["cycleDevices"] = bs.cycleDevices;
+  }
 }
 
 namespace {
 
-std::string FuzzifyInterface(const std::string& name) {
-  // Windows likes to replace "Foo" with "2- Foo"
-  const std::regex pattern{"^([0-9]+- )?(.+)$"};
-  std::smatch captures;
-  if (!std::regex_match(name, captures, pattern)) {
-    return name;
+// Overloaded below, which would otherwise hide these
+using FredEmmott::Audio::AppendBinary;
+using FredEmmott::Audio::AppendJSON;
+using FredEmmott::Audio::ReadBinary;
+
+void AppendJSON(std::string& out, bool value) {
+  out.append(value ? "true" : "false");
+}
+
+void AppendJSON(std::string& out, const HotkeyConfig& hk) {
+  // Sorted keys, as in dump()
+  out.append(R"({"alt":)");
+  AppendJSON(out, hk.alt);
+  out.append(R"(,"ctrl":)");
+  AppendJSON(out, hk.ctrl);
+  out.append(R"(,"enabled":)");
+  AppendJSON(out, hk.enabled);
+  out.append(R"(,"keyCode":)");
+  AppendJSON(out, std::string_view{hk.keyCode});
+  out.append(R"(,"shift":)");
+  AppendJSON(out, hk.shift);
+  out.append(R"(,"win":)");
+  AppendJSON(out, hk.win);
+  out.push_back('}');
+}
+
+void AppendJSON(std::string& out, const SwitchTarget& target) {
+  out.append(R"({"device":)");
+  AppendJSON(out, target.device);
+  out.append(R"(,"direction":)");
+  AppendJSON(out, target.direction);
+  out.append(R"(,"role":)");
+  AppendJSON(out, target.role);
+  out.push_back('}');
+}
+
+template <class T>
+void AppendJSONArray(std::string& out, const std::vector<T>& values) {
+  out.push_back('[');
+  for (const auto& value : values) {
+    if (&value != &values.front()) {
+      out.push_back(',');
+    }
+    AppendJSON(out, value);
+  }
+  out.push_back(']');
+}
+
+enum class MatchStrategyCode : uint8_t {
+  ID = 0,
+  Fuzzy = 1,
+};
+
+enum HotkeyFlag : uint8_t {
+  HOTKEY_FLAG_ENABLED = 1 << 0,
+  HOTKEY_FLAG_CTRL = 1 << 1,
+  HOTKEY_FLAG_ALT = 1 << 2,
+  HOTKEY_FLAG_SHIFT = 1 << 3,
+  HOTKEY_FLAG_WIN = 1 << 4,
+};
+
+bool ReadByte(std::string_view& in, uint8_t& value) {
+  if (in.empty()) {
+    return false;
+  }
+  value = static_cast<uint8_t>(in.front());
+  in.remove_prefix(1);
+  return true;
+}
+
+void AppendBinary(std::string& out, const HotkeyConfig& hk) {
+  out.push_back(static_cast<char>(
+    (hk.enabled ? HOTKEY_FLAG_ENABLED : 0) | (hk.ctrl ? HOTKEY_FLAG_CTRL : 0)
+    | (hk.alt ? HOTKEY_FLAG_ALT : 0) | (hk.shift ? HOTKEY_FLAG_SHIFT : 0)
+    | (hk.win ? HOTKEY_FLAG_WIN : 0)));
+  AppendBinary(out, std::string_view{hk.keyCode});
+}
+
+bool ReadBinary(std::string_view& in, HotkeyConfig& hk) {
+  uint8_t flags;
+  if (!(ReadByte(in, flags) && ReadBinary(in, hk.keyCode))) {
+    return false;
+  }
+  hk.enabled = flags & HOTKEY_FLAG_ENABLED;
+  hk.ctrl = flags & HOTKEY_FLAG_CTRL;
+  hk.alt = flags & HOTKEY_FLAG_ALT;
+  hk.shift = flags & HOTKEY_FLAG_SHIFT;
+  hk.win = flags & HOTKEY_FLAG_WIN;
+  // Not stored, as the key codes are per-platform
+  hk.compiled = CompileHotkey(hk);
+  return true;
+}
+
+void AppendBinary(std::string& out, const SwitchTarget& target) {
+  AppendBinary(out, target.direction);
+  AppendBinary(out, target.role);
+  AppendBinary(out, target.device);
+}
+
+bool ReadBinary(std::string_view& in, SwitchTarget& target) {
+  return ReadBinary(in, target.direction) && ReadBinary(in, target.role)
+    && ReadBinary(in, target.device);
+}
+
+template <class T>
+void AppendBinaryArray(std::string& out, const std::vector<T>& values) {
+  AppendBinary(out, static_cast<uint32_t>(values.size()));
+  for (const auto& value : values) {
+    AppendBinary(out, value);
+  }
+}
+
+template <class T>
+bool ReadBinaryArray(std::string_view& in, std::vector<T>& values) {
+  uint32_t count;
+  if (!ReadBinary(in, count)) {
+    return false;
+  }
+  values.clear();
+  for (uint32_t i = 0; i < count; ++i) {
+    if (!ReadBinary(in, values.emplace_back())) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}// namespace
+
+void AppendJSON(std::string& out, const ButtonSettings& bs) {
+  // Sorted keys, as in dump(); the arrays are only there if non-empty, as
+  // in to_json()
+  out.push_back('{');
+  if (!bs.cycleDevices.empty()) {
+    out.append(R"("cycleDevices":)");
+    AppendJSONArray(out, bs.cycleDevices);
+    out.push_back(',');
   }
-  return captures[2];
+  out.append(R"("direction":)");
+  AppendJSON(out, bs.direction);
+  out.append(R"(,"hotkeysWaitForSwitch":)");
+  AppendJSON(out, bs.hotkeysWaitForSwitch);
+  out.append(R"(,"matchStrategy":)");
+  AppendJSON(
+    out,
+    std::string_view{
+      bs.matchStrategy == DeviceMatchStrategy::Fuzzy ? "Fuzzy" : "ID"});
+  out.append(R"(,"primary":)");
+  AppendJSON(out, bs.primaryDevice);
+  out.append(R"(,"primaryHotkey":)");
+  AppendJSON(out, bs.primaryHotkey);
+  out.append(R"(,"role":)");
+  AppendJSON(out, bs.role);
+  out.append(R"(,"secondary":)");
+  AppendJSON(out, bs.secondaryDevice);
+  out.append(R"(,"secondaryHotkey":)");
+  AppendJSON(out, bs.secondaryHotkey);
+  if (!bs.targets.empty()) {
+    out.append(R"(,"targets":)");
+    AppendJSONArray(out, bs.targets);
+  }
+  out.push_back('}');
+}
+
+void AppendBinary(std::string& out, const ButtonSettings& bs) {
+  AppendBinary(out, bs.direction);
+  AppendBinary(out, bs.role);
+  AppendBinary(out, bs.primaryDevice);
+  AppendBinary(out, bs.secondaryDevice);
+  out.push_back(static_cast<char>(
+    bs.matchStrategy == DeviceMatchStrategy::Fuzzy ? MatchStrategyCode::Fuzzy
+                                                   : MatchStrategyCode::ID));
+  AppendBinary(out, bs.primaryHotkey);
+  AppendBinary(out, bs.secondaryHotkey);
+  out.push_back(static_cast<char>(bs.hotkeysWaitForSwitch));
+  AppendBinaryArray(out, bs.targets);
+  AppendBinaryArray(out, bs.cycleDevices);
 }
 
-std::string GetVolatileID(
+bool ReadBinary(std::string_view& in, ButtonSettings& bs) {
+  uint8_t matchStrategy;
+  uint8_t hotkeysWaitForSwitch;
+  if (!(ReadBinary(in, bs.direction) && ReadBinary(in, bs.role)
+        && ReadBinary(in, bs.primaryDevice)
+        && ReadBinary(in, bs.secondaryDevice) && ReadByte(in, matchStrategy)
+        && ReadBinary(in, bs.primaryHotkey)
+        && ReadBinary(in, bs.secondaryHotkey)
+        && ReadByte(in, hotkeysWaitForSwitch)
+        && ReadBinaryArray(in, bs.targets)
+        && ReadBinaryArray(in, bs.cycleDevices))) {
+    return false;
+  }
+  switch (static_cast<MatchStrategyCode>(matchStrategy)) {
+    case MatchStrategyCode::ID:
+      bs.matchStrategy = DeviceMatchStrategy::ID;
+      break;
+    case MatchStrategyCode::Fuzzy:
+      bs.matchStrategy = DeviceMatchStrategy::Fuzzy;
+      break;
+    default:
+      return false;
+  }
+  bs.hotkeysWaitForSwitch = hotkeysWaitForSwitch != 0;
+  bs.InternDeviceIDs();
+  return true;
+}
+
+namespace {
+
+// How often a failed fuzzy match can enumerate again
+constexpr std::chrono::seconds FUZZY_MISS_REFRESH_INTERVAL{1};
+
+DeviceHandle GetVolatileDevice(
   const AudioDeviceInfo& device,
-  DeviceMatchStrategy strategy) {
-  if (device.id.empty()) {
-    return {};
+  DeviceHandle handle,
+  DeviceMatchStrategy strategy,
+  AudioDeviceCache& cache) {
+  if (handle == NO_DEVICE || strategy == DeviceMatchStrategy::ID) {
+    return handle;
+  }
+
+  const auto state = cache.GetState(handle);
+  if (state == AudioDeviceState::CONNECTED) {
+    return handle;
   }
 
-  if (strategy == DeviceMatchStrategy::ID) {
-    return device.id;
+  // We don't get notifications when devices are added or removed, but if
+  // the snapshot disagrees with the backend about this device, it's stale.
+  auto snapshot = cache.Get(device.direction);
+  const auto cached = snapshot->devices.find(device.id);
+  if (cached != snapshot->devices.end() && cached->second.state != state) {
+    cache.Invalidate(device.direction);
+    snapshot = cache.Get(device.direction);
   }
 
-  if (GetAudioDeviceState(device.id) == AudioDeviceState::CONNECTED) {
-    return device.id;
+  auto match = snapshot->FindFuzzyMatch(device);
+  if (match == NO_DEVICE) {
+    // Nor are we told about new devices, so a replugged device with a new ID
+    // may not be in the snapshot yet
+    snapshot = cache.RefreshIfOlderThan(
+      device.direction, FUZZY_MISS_REFRESH_INTERVAL);
+    match = snapshot->FindFuzzyMatch(device);
+  }
+  if (match == NO_DEVICE) {
+    PluginDebug(
+      "Failed fuzzy match for {}/{}",
+      device.interfaceName,
+      device.endpointName);
+    return handle;
   }
 
-  const auto fuzzyInterface = FuzzifyInterface(device.interfaceName);
-  ESDDebug(
-    "Looking for a fuzzy match: {} -> {}",
+  PluginDebug(
+    "Fuzzy device match for {}/{}: {}",
     device.interfaceName,
-    fuzzyInterface);
+    device.endpointName,
+    GetDeviceID(match));
+  return match;
+}
+}// namespace
 
-  for (const auto& [otherID, other] : GetAudioDeviceList(device.direction)) {
-    if (other.state != AudioDeviceState::CONNECTED) {
+DeviceHandle ButtonSettings::VolatilePrimaryDevice(
+  AudioDeviceCache& cache) const {
+  return GetVolatileDevice(primaryDevice, primaryHandle, matchStrategy, cache);
+}
+
+DeviceHandle ButtonSettings::VolatileSecondaryDevice(
+  AudioDeviceCache& cache) const {
+  return GetVolatileDevice(
+    secondaryDevice, secondaryHandle, matchStrategy, cache);
+}
+
+DeviceHandle ButtonSettings::VolatileTargetDevice(
+  const SwitchTarget& target,
+  AudioDeviceCache& cache) const {
+  return GetVolatileDevice(
+    target.device, target.deviceHandle, matchStrategy, cache);
+}
+
+std::vector<DeviceHandle> ButtonSettings::VolatileCycleDevices(
+  const AudioDeviceSnapshot& snapshot) const {
+  std::vector<DeviceHandle> devices;
+  devices.reserve(cycleDevices.size());
+  for (size_t i = 0; i < cycleDevices.size(); ++i) {
+    const auto& device = cycleDevices.at(i);
+    const auto handle = cycleHandles.at(i);
+    if (handle == NO_DEVICE) {
       continue;
     }
-    const auto otherFuzzyInterface = FuzzifyInterface(other.interfaceName);
-    ESDDebug("Trying {} -> {}", other.interfaceName, otherFuzzyInterface);
+    if (matchStrategy == DeviceMatchStrategy::ID) {
+      devices.push_back(handle);
+      continue;
+    }
+    const auto it = snapshot.devices.find(device.id);
     if (
-      fuzzyInterface == otherFuzzyInterface
-      && device.endpointName == other.endpointName) {
-      ESDDebug(
-        "Fuzzy device match for {}/{}",
-        device.interfaceName,
-        device.endpointName);
-      return otherID;
+      it != snapshot.devices.end()
+      && it->second.state == AudioDeviceState::CONNECTED) {
+      devices.push_back(handle);
+      continue;
     }
+    const auto match = snapshot.FindFuzzyMatch(device);
+    devices.push_back(match == NO_DEVICE ? handle : match);
   }
-  ESDDebug(
-    "Failed fuzzy match for {}/{}", device.interfaceName, device.endpointName);
-  return device.id;
-}
-}// namespace
-
-std::string ButtonSettings::VolatilePrimaryID() const {
-  return GetVolatileID(primaryDevice, matchStrategy);
+  return devices;
 }
 
-std::string ButtonSettings::VolatileSecondaryID() const {
-  return GetVolatileID(secondaryDevice, matchStrategy);
+void ButtonSettings::InternDeviceIDs() {
+  primaryHandle = InternDeviceID(primaryDevice.id);
+  secondaryHandle = InternDeviceID(secondaryDevice.id);
+  for (auto& target : targets) {
+    target.deviceHandle = InternDeviceID(target.device.id);
+  }
+  cycleHandles.clear();
+  cycleHandles.reserve(cycleDevices.size());
+  for (const auto& device : cycleDevices) {
+    cycleHandles.push_back(InternDeviceID(device.id));
+  }
 }
@@ -9,6 +9,16 @@
 
 #include <nlohmann/json.hpp>
 
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "DeviceIDTable.h"
+#include "Hotkey.h"
+
+class AudioDeviceCache;
+struct AudioDeviceSnapshot;
+
 using namespace FredEmmott::Audio;
 
 enum class DeviceMatchStrategy {
@@ -23,21 +33,61 @@ struct HotkeyConfig {
   bool shift = false;
   bool win = false;// Command key on macOS
   std::string keyCode = "";// Key identifier
+  // Derived from the above by from_json()
+  CompiledHotkey compiled;
+};
+
+// One device change made by the 'set multiple devices' action
+struct SwitchTarget {
+  AudioDeviceDirection direction = AudioDeviceDirection::OUTPUT;
+  AudioDeviceRole role = AudioDeviceRole::DEFAULT;
+  // Value-initialized, as AudioDeviceInfo's enums have no defaults
+  AudioDeviceInfo device{};
+  // Set by ButtonSettings::InternDeviceIDs()
+  DeviceHandle deviceHandle = NO_DEVICE;
 };
 
 struct ButtonSettings {
   AudioDeviceDirection direction = AudioDeviceDirection::INPUT;
   AudioDeviceRole role = AudioDeviceRole::DEFAULT;
-  AudioDeviceInfo primaryDevice;
-  AudioDeviceInfo secondaryDevice;
+  AudioDeviceInfo primaryDevice{};
+  AudioDeviceInfo secondaryDevice{};
   DeviceMatchStrategy matchStrategy = DeviceMatchStrategy::ID;
   HotkeyConfig primaryHotkey;
   HotkeyConfig secondaryHotkey;
+  // Send the hotkey once the OS reports the new default device, rather than
+  // as soon as it has been requested
+  bool hotkeysWaitForSwitch = false;
+  // Only used by the 'set multiple devices' action
+  std::vector<SwitchTarget> targets;
+  // Only used by the 'cycle' action, in rotation order
+  std::vector<AudioDeviceInfo> cycleDevices;
+
+  // The interned IDs of the devices above, so that a press can compare
+  // handles without taking DeviceIDTable's lock. Set by from_json() and
+  // ReadBinary(); call InternDeviceIDs() after changing the devices directly.
+  DeviceHandle primaryHandle = NO_DEVICE;
+  DeviceHandle secondaryHandle = NO_DEVICE;
+  std::vector<DeviceHandle> cycleHandles;
+  void InternDeviceIDs();
 
   // Changes if there's a fuzzy match
-  std::string VolatilePrimaryID() const;
-  std::string VolatileSecondaryID() const;
+  DeviceHandle VolatilePrimaryDevice(AudioDeviceCache&) const;
+  DeviceHandle VolatileSecondaryDevice(AudioDeviceCache&) const;
+  DeviceHandle VolatileTargetDevice(const SwitchTarget&, AudioDeviceCache&)
+    const;
+  // Resolved against the snapshot only, without querying the devices
+  std::vector<DeviceHandle> VolatileCycleDevices(
+    const AudioDeviceSnapshot&) const;
 };
 
 void from_json(const nlohmann::json&, ButtonSettings&);
 void to_json(nlohmann::json&, const ButtonSettings&);
+
+// The same text as to_json() then dump(); see audio_json.h
+void AppendJSON(std::string& out, const ButtonSettings&);
+
+// See audio_binary.h. There's no version number, so anything kept between
+// runs needs its own, as AudioDeviceCache's file has.
+void AppendBinary(std::string& out, const ButtonSettings&);
+bool ReadBinary(std::string_view& in, ButtonSettings&);
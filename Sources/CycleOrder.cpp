@@ -0,0 +1,89 @@
+/* Copyright (c) 2018-present, Fred Emmott
+ *
+ * This source code is licensed under the MIT-style license found in the
+ * LICENSE file.
+ */
+
+#include "CycleOrder.h"
+
+#include "AudioDeviceCache.h"
+#include "ButtonSettings.h"
+
+bool CycleOrder::Update(
+  const ButtonSettings& settings,
+  std::size_t settingsHash,
+  const AudioDeviceSnapshot& snapshot) {
+  if (
+    snapshot.version == mSnapshotVersion && settingsHash == mSettingsHash) {
+    return false;
+  }
+
+  mSnapshotVersion = snapshot.version;
+  mSettingsHash = settingsHash;
+  mDevices = settings.VolatileCycleDevices(snapshot);
+  const auto count = mDevices.size();
+
+  mIndices.clear();
+  mConnected.assign(count, false);
+  for (size_t i = 0; i < count; ++i) {
+    // If a device is listed twice, rotate from its first position
+    mIndices.try_emplace(mDevices[i], i);
+    const auto it = snapshot.devices.find(GetDeviceID(mDevices[i]));
+    mConnected[i] = it != snapshot.devices.end()
+      && it->second.state == AudioDeviceState::CONNECTED;
+  }
+  BuildNext();
+  return true;
+}
+
+void CycleOrder::SetConnected(DeviceHandle device, bool connected) {
+  if (!mIndices.contains(device)) {
+    return;
+  }
+  bool changed = false;
+  for (size_t i = 0; i < mDevices.size(); ++i) {
+    if (mDevices[i] == device && mConnected[i] != connected) {
+      mConnected[i] = connected;
+      changed = true;
+    }
+  }
+  if (changed) {
+    BuildNext();
+  }
+}
+
+void CycleOrder::Invalidate() {
+  mSnapshotVersion = 0;
+}
+
+void CycleOrder::BuildNext() {
+  const auto count = mDevices.size();
+  // Walk backwards around the list twice, so every element sees the
+  // nearest connected device after it, including across the wrap
+  mNext.assign(count + 1, NONE);
+  size_t next = NONE;
+  for (size_t n = 2 * count; n > 0; --n) {
+    const auto i = (n - 1) % count;
+    if (n <= count) {
+      mNext[i] = next;
+    }
+    if (mConnected[i]) {
+      next = i;
+    }
+  }
+  mNext[count] = next;
+}
+
+DeviceHandle CycleOrder::GetNext(DeviceHandle current) const {
+  if (mDevices.empty()) {
+    return NO_DEVICE;
+  }
+
+  const auto it = mIndices.find(current);
+  const auto next
+    = mNext[(it == mIndices.end()) ? mDevices.size() : it->second];
+  if (next == NONE) {
+    return NO_DEVICE;
+  }
+  return mDevices[next];
+}
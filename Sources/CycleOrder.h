@@ -0,0 +1,59 @@
+/* Copyright (c) 2018-present, Fred Emmott
+ *
+ * This source code is licensed under the MIT-style license found in the
+ * LICENSE file.
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "DeviceIDTable.h"
+
+struct AudioDeviceSnapshot;
+struct ButtonSettings;
+
+// The rotation order for the 'cycle' action.
+//
+// The devices are resolved against the device snapshot, and the table of
+// 'next connected device' is built, only when the settings or snapshot
+// change. Device state notifications update it in between, so choosing the
+// next device on a key press is O(1) and doesn't query any devices.
+class CycleOrder {
+ public:
+  // Resolves the devices again if the settings or snapshot have changed
+  // since the last call. Returns false if nothing changed.
+  bool Update(
+    const ButtonSettings& settings,
+    std::size_t settingsHash,
+    const AudioDeviceSnapshot& snapshot);
+
+  // For device state notifications; does nothing if the device isn't in the
+  // list
+  void SetConnected(DeviceHandle, bool connected);
+  // Resolve again on the next Update(), e.g. if we don't know which devices
+  // changed
+  void Invalidate();
+
+  // The first connected device after `current` in the list; if `current`
+  // isn't in the list, the first connected device. Returns
+  // NO_DEVICE if no devices are connected.
+  DeviceHandle GetNext(DeviceHandle current) const;
+
+ private:
+  static constexpr size_t NONE = SIZE_MAX;
+
+  // Snapshot versions start at 1, so the first Update() always resolves
+  uint64_t mSnapshotVersion = 0;
+  std::size_t mSettingsHash = 0;
+  std::vector<DeviceHandle> mDevices;
+  std::unordered_map<DeviceHandle, size_t> mIndices;
+  std::vector<bool> mConnected;
+  // mNext[i] is the index of the first connected device after i, wrapping
+  // around; the extra last element is the first connected device overall.
+  std::vector<size_t> mNext;
+
+  void BuildNext();
+};
@@ -0,0 +1,81 @@
+/* Copyright (c) 2018-present, Fred Emmott
+ *
+ * This source code is licensed under the MIT-style license found in the
+ * LICENSE file.
+ */
+
+#include "DebugLog.h"
+
+#include <StreamDeckSDK/ESDLogger.h>
+
+#include <string_view>
+#include <thread>
+
+#ifdef NDEBUG
+std::atomic<bool> DebugLog::gEnabled{false};
+#else
+std::atomic<bool> DebugLog::gEnabled{true};
+#endif
+
+void DebugLog::SetEnabled(bool enabled) {
+  gEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+DebugLog& DebugLog::Get() {
+  static DebugLog* instance = new DebugLog();
+  return *instance;
+}
+
+DebugLog::DebugLog() {
+  for (size_t i = 0; i < CAPACITY; ++i) {
+    mSlots[i].sequence.store(i, std::memory_order_relaxed);
+  }
+  std::thread([this]() { Run(); }).detach();
+}
+
+DebugLog::Slot* DebugLog::Reserve() {
+  auto position = mWritePosition.load(std::memory_order_relaxed);
+  while (true) {
+    auto& slot = mSlots[position % CAPACITY];
+    const auto sequence = slot.sequence.load(std::memory_order_acquire);
+    if (sequence == position) {
+      if (mWritePosition.compare_exchange_weak(
+            position, position + 1, std::memory_order_relaxed)) {
+        return &slot;
+      }
+      // `position` has been updated by the failed exchange
+    } else if (sequence < position) {
+      // Not yet drained since the last time around the buffer
+      mDroppedCount.fetch_add(1, std::memory_order_relaxed);
+      return nullptr;
+    } else {
+      // Another thread took this slot
+      position = mWritePosition.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+void DebugLog::Publish(Slot* slot) {
+  const auto sequence = slot->sequence.load(std::memory_order_relaxed);
+  slot->sequence.store(sequence + 1, std::memory_order_release);
+}
+
+void DebugLog::Run() {
+  while (true) {
+    while (true) {
+      auto& slot = mSlots[mReadPosition % CAPACITY];
+      const auto sequence = slot.sequence.load(std::memory_order_acquire);
+      if (sequence != mReadPosition + 1) {
+        break;
+      }
+      ESDLog("{}", std::string_view(slot.text.data(), slot.size));
+      slot.sequence.store(mReadPosition + CAPACITY, std::memory_order_release);
+      ++mReadPosition;
+    }
+
+    if (const auto dropped = mDroppedCount.exchange(0)) {
+      ESDLog("Dropped {} debug log messages", dropped);
+    }
+    std::this_thread::sleep_for(DRAIN_INTERVAL);
+  }
+}
@@ -0,0 +1,121 @@
+/* Copyright (c) 2018-present, Fred Emmott
+ *
+ * This source code is licensed under the MIT-style license found in the
+ * LICENSE file.
+ */
+#pragma once
+
+#include <fmt/format.h>
+
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+// Debug logging for hot paths.
+//
+// Arguments are only evaluated if debug logging is enabled. Messages are
+// formatted into a fixed-size slot in a lock-free ring buffer, and passed on
+// to the Stream Deck log by a background thread, so logging doesn't allocate
+// or block the caller unless an argument does.
+#define PluginDebug(...) \
+  do { \
+    if (DebugLog::IsEnabled()) { \
+      DebugLog::Get().Write(__VA_ARGS__); \
+    } \
+  } while (0)
+
+class DebugLog {
+ public:
+  // Longer messages are truncated
+  static constexpr size_t MAX_MESSAGE_SIZE = 512;
+  // If the ring buffer is full, messages are dropped
+  static constexpr size_t CAPACITY = 256;
+  // Writers don't wake the drain thread, as that would need a lock or a
+  // syscall; std::atomic::wait() isn't available on our oldest macOS.
+  static constexpr std::chrono::milliseconds DRAIN_INTERVAL{50};
+
+  static bool IsEnabled() {
+    return gEnabled.load(std::memory_order_relaxed);
+  }
+  static void SetEnabled(bool);
+
+  // Never destroyed, as the plugin's threads may log until the process exits
+  static DebugLog& Get();
+
+  DebugLog(const DebugLog&) = delete;
+  DebugLog& operator=(const DebugLog&) = delete;
+
+  template <class... Args>
+  void Write(fmt::format_string<Args...> format, Args&&... args) {
+    auto slot = Reserve();
+    if (!slot) {
+      return;
+    }
+    const auto result = fmt::format_to_n(
+      slot->text.data(),
+      slot->text.size(),
+      format,
+      std::forward<Args>(args)...);
+    slot->size = std::min(result.size, slot->text.size());
+    Publish(slot);
+  }
+
+ private:
+  struct Slot {
+    // The write position this slot is next writable at, or that plus one
+    // once the message has been written
+    std::atomic<size_t> sequence;
+    size_t size = 0;
+    std::array<char, MAX_MESSAGE_SIZE> text;
+  };
+
+  static std::atomic<bool> gEnabled;
+
+  std::array<Slot, CAPACITY> mSlots;
+  std::atomic<size_t> mWritePosition{0};
+  // Only used by the drain thread
+  size_t mReadPosition = 0;
+  std::atomic<uint64_t> mDroppedCount{0};
+
+  DebugLog();
+
+  Slot* Reserve();
+  void Publish(Slot*);
+  void Run();
+};
+
+// Formats as JSON, but only converts and serializes the value if the
+// message is actually written
+template <class T>
+struct LogJSON {
+  const T& value;
+};
+template <class T>
+LogJSON(const T&) -> LogJSON<T>;
+
+template <class T>
+struct fmt::formatter<LogJSON<T>> {
+  constexpr auto parse(fmt::format_parse_context& ctx) {
+    return ctx.begin();
+  }
+
+  template <class FormatContext>
+  auto format(const LogJSON<T>& json, FormatContext& ctx) const {
+    std::string dumped;
+    if constexpr (std::is_same_v<T, nlohmann::json>) {
+      dumped = json.value.dump();
+    } else if constexpr (requires { AppendJSON(dumped, json.value); }) {
+      // The same text, without building a tree first
+      AppendJSON(dumped, json.value);
+    } else {
+      dumped = nlohmann::json(json.value).dump();
+    }
+    return std::copy(dumped.begin(), dumped.end(), ctx.out());
+  }
+};
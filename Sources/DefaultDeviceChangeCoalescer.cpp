@@ -0,0 +1,83 @@
+/* Copyright (c) 2018-present, Fred Emmott
+ *
+ * This source code is licensed under the MIT-style license found in the
+ * LICENSE file.
+ */
+
+#include "DefaultDeviceChangeCoalescer.h"
+
+#ifdef _MSC_VER
+#include <objbase.h>
+#endif
+
+DefaultDeviceChangeCoalescer::DefaultDeviceChangeCoalescer(
+  std::chrono::milliseconds window,
+  Callback callback)
+  : mWindow(window), mCallback(std::move(callback)) {
+  mThread = std::thread([this]() { Run(); });
+}
+
+DefaultDeviceChangeCoalescer::~DefaultDeviceChangeCoalescer() {
+  {
+    std::scoped_lock lock(mMutex);
+    mStopping = true;
+  }
+  mCV.notify_all();
+  mThread.join();
+}
+
+void DefaultDeviceChangeCoalescer::Push(
+  AudioDeviceDirection direction,
+  AudioDeviceRole role,
+  DeviceHandle device) {
+  ++mNotificationCount;
+  {
+    std::scoped_lock lock(mMutex);
+    if (mPending.empty()) {
+      // The window starts at the first notification of a burst; later ones
+      // don't extend it, so a steady stream can't starve the buttons.
+      mDeadline = std::chrono::steady_clock::now() + mWindow;
+    }
+    auto& change = mPending[{direction, role}];
+    change.device = device;
+    ++change.notificationCount;
+  }
+  mCV.notify_one();
+}
+
+uint64_t DefaultDeviceChangeCoalescer::GetNotificationCount() const {
+  return mNotificationCount;
+}
+
+uint64_t DefaultDeviceChangeCoalescer::GetBurstCount() const {
+  return mBurstCount;
+}
+
+void DefaultDeviceChangeCoalescer::Run() {
+#ifdef _MSC_VER
+  // The callback may need to query devices
+  CoInitializeEx(NULL, COINIT_MULTITHREADED);
+#endif
+
+  while (true) {
+    Changes changes;
+    {
+      std::unique_lock lock(mMutex);
+      mCV.wait(lock, [this]() { return mStopping || !mPending.empty(); });
+      if (mStopping) {
+        break;
+      }
+      mCV.wait_until(lock, mDeadline, [this]() { return mStopping; });
+      if (mStopping) {
+        break;
+      }
+      changes.swap(mPending);
+    }
+    ++mBurstCount;
+    mCallback(changes);
+  }
+
+#ifdef _MSC_VER
+  CoUninitialize();
+#endif
+}
@@ -0,0 +1,71 @@
+/* Copyright (c) 2018-present, Fred Emmott
+ *
+ * This source code is licensed under the MIT-style license found in the
+ * LICENSE file.
+ */
+#pragma once
+
+#include <AudioDevices/AudioDevices.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+
+#include "DeviceIDTable.h"
+
+using namespace FredEmmott::Audio;
+
+// A single switch can produce several default-device notifications in quick
+// succession (e.g. one per role, then another for the communication role);
+// collect them for a short window, then deliver only the latest for each
+// direction and role.
+class DefaultDeviceChangeCoalescer {
+ public:
+  using Key = std::pair<AudioDeviceDirection, AudioDeviceRole>;
+  struct Change {
+    DeviceHandle device = NO_DEVICE;
+    // How many notifications were collapsed into this one
+    uint64_t notificationCount = 0;
+  };
+  using Changes = std::map<Key, Change>;
+  using Callback = std::function<void(const Changes&)>;
+
+  DefaultDeviceChangeCoalescer(std::chrono::milliseconds window, Callback);
+  ~DefaultDeviceChangeCoalescer();
+
+  DefaultDeviceChangeCoalescer(const DefaultDeviceChangeCoalescer&) = delete;
+  DefaultDeviceChangeCoalescer& operator=(const DefaultDeviceChangeCoalescer&)
+    = delete;
+
+  void Push(
+    AudioDeviceDirection direction,
+    AudioDeviceRole role,
+    DeviceHandle device);
+
+  uint64_t GetNotificationCount() const;
+  uint64_t GetBurstCount() const;
+
+ private:
+  const std::chrono::milliseconds mWindow;
+  const Callback mCallback;
+
+  std::mutex mMutex;
+  std::condition_variable mCV;
+  Changes mPending;
+  std::chrono::steady_clock::time_point mDeadline;
+  bool mStopping = false;
+
+  std::atomic<uint64_t> mNotificationCount{0};
+  std::atomic<uint64_t> mBurstCount{0};
+
+  std::thread mThread;
+
+  void Run();
+};
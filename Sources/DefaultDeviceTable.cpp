@@ -0,0 +1,80 @@
+/* Copyright (c) 2018-present, Fred Emmott
+ *
+ * This source code is licensed under the MIT-style license found in the
+ * LICENSE file.
+ */
+
+#include "DefaultDeviceTable.h"
+
+using namespace FredEmmott::Audio;
+
+namespace {
+
+constexpr uint64_t COUNT_SHIFT = 32;
+
+DeviceHandle GetHandle(uint64_t entry) {
+  return static_cast<DeviceHandle>(entry);
+}
+
+uint64_t WithHandle(uint64_t entry, DeviceHandle handle) {
+  return (((entry >> COUNT_SHIFT) + 1) << COUNT_SHIFT) | handle;
+}
+
+}// namespace
+
+DeviceHandle DefaultDeviceTable::Get(
+  AudioDeviceDirection direction,
+  AudioDeviceRole role) {
+  auto& entry = mEntries.at(GetIndex(direction, role));
+  auto current = entry.load();
+  const auto handle = GetHandle(current);
+  if (handle != UNKNOWN) {
+    return handle;
+  }
+
+  const auto queried = Query(direction, role);
+  // If it changed while we were querying, that's more up to date
+  entry.compare_exchange_strong(current, WithHandle(current, queried));
+  return queried;
+}
+
+DeviceHandle DefaultDeviceTable::Refresh(
+  AudioDeviceDirection direction,
+  AudioDeviceRole role) {
+  const auto queried = Query(direction, role);
+  Store(GetIndex(direction, role), queried);
+  return queried;
+}
+
+void DefaultDeviceTable::Set(
+  AudioDeviceDirection direction,
+  AudioDeviceRole role,
+  DeviceHandle device) {
+  Store(GetIndex(direction, role), device);
+}
+
+void DefaultDeviceTable::Invalidate(
+  AudioDeviceDirection direction,
+  AudioDeviceRole role) {
+  Store(GetIndex(direction, role), UNKNOWN);
+}
+
+size_t DefaultDeviceTable::GetIndex(
+  AudioDeviceDirection direction,
+  AudioDeviceRole role) {
+  return (direction == AudioDeviceDirection::OUTPUT ? 0 : 2)
+    + (role == AudioDeviceRole::DEFAULT ? 0 : 1);
+}
+
+DeviceHandle DefaultDeviceTable::Query(
+  AudioDeviceDirection direction,
+  AudioDeviceRole role) {
+  return InternDeviceID(GetDefaultAudioDeviceID(direction, role));
+}
+
+void DefaultDeviceTable::Store(size_t index, DeviceHandle device) {
+  auto& entry = mEntries.at(index);
+  auto current = entry.load();
+  while (!entry.compare_exchange_weak(current, WithHandle(current, device))) {
+  }
+}
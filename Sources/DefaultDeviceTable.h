@@ -0,0 +1,66 @@
+/* Copyright (c) 2018-present, Fred Emmott
+ *
+ * This source code is licensed under the MIT-style license found in the
+ * LICENSE file.
+ */
+#pragma once
+
+#include <AudioDevices/AudioDevices.h>
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "DeviceIDTable.h"
+
+// The default device for each direction and role, kept up to date by
+// default device notifications so that a key press can compare handles
+// without asking the audio system, or taking DeviceIDTable's lock.
+//
+// Each default is queried with GetDefaultAudioDeviceID() the first time it's
+// needed, and again after Invalidate(). Lock-free, so any thread can use it.
+class DefaultDeviceTable {
+ public:
+  DeviceHandle Get(
+    FredEmmott::Audio::AudioDeviceDirection,
+    FredEmmott::Audio::AudioDeviceRole);
+  // Queries the audio system even if the default is known, and stores the
+  // result
+  DeviceHandle Refresh(
+    FredEmmott::Audio::AudioDeviceDirection,
+    FredEmmott::Audio::AudioDeviceRole);
+
+  // From a default device notification
+  void Set(
+    FredEmmott::Audio::AudioDeviceDirection,
+    FredEmmott::Audio::AudioDeviceRole,
+    DeviceHandle);
+  // After changing the default ourselves: the change may not have worked,
+  // and the notification may not have arrived yet
+  void Invalidate(
+    FredEmmott::Audio::AudioDeviceDirection,
+    FredEmmott::Audio::AudioDeviceRole);
+
+ private:
+  // A change count in the high 32 bits, and the handle - or UNKNOWN - in the
+  // low 32. Bumping the count on every change means that a query that raced
+  // with one can't overwrite it.
+  using Entry = uint64_t;
+  static constexpr DeviceHandle UNKNOWN = ~DeviceHandle{0};
+
+  std::array<std::atomic<Entry>, 4> mEntries{
+    UNKNOWN,
+    UNKNOWN,
+    UNKNOWN,
+    UNKNOWN,
+  };
+
+  static size_t GetIndex(
+    FredEmmott::Audio::AudioDeviceDirection,
+    FredEmmott::Audio::AudioDeviceRole);
+  static DeviceHandle Query(
+    FredEmmott::Audio::AudioDeviceDirection,
+    FredEmmott::Audio::AudioDeviceRole);
+  void Store(size_t index, DeviceHandle);
+};
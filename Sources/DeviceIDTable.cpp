@@ -0,0 +1,56 @@
+/* Copyright (c) 2018-present, Fred Emmott
+ *
+ * This source code is licensed under the MIT-style license found in the
+ * LICENSE file.
+ */
+
+#include "DeviceIDTable.h"
+
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+
+namespace {
+
+// Allows looking up a std::string key with a std::string_view
+struct StringHash {
+  using is_transparent = void;
+  size_t operator()(std::string_view s) const {
+    return std::hash<std::string_view>{}(s);
+  }
+};
+
+struct DeviceIDTable {
+  std::mutex mutex;
+  // A deque, so that references stay valid as it grows
+  std::deque<std::string> ids{""};
+  std::unordered_map<std::string, DeviceHandle, StringHash, std::equal_to<>>
+    handles{{"", NO_DEVICE}};
+};
+
+DeviceIDTable& GetTable() {
+  static DeviceIDTable table;
+  return table;
+}
+
+}// namespace
+
+DeviceHandle InternDeviceID(std::string_view id) {
+  auto& table = GetTable();
+  std::scoped_lock lock(table.mutex);
+  const auto it = table.handles.find(id);
+  if (it != table.handles.end()) {
+    return it->second;
+  }
+  const auto handle = static_cast<DeviceHandle>(table.ids.size());
+  table.ids.emplace_back(id);
+  table.handles.emplace(table.ids.back(), handle);
+  return handle;
+}
+
+const std::string& GetDeviceID(DeviceHandle handle) {
+  auto& table = GetTable();
+  std::scoped_lock lock(table.mutex);
+  return table.ids.at(handle);
+}
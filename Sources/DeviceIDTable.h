@@ -0,0 +1,26 @@
+/* Copyright (c) 2018-present, Fred Emmott
+ *
+ * This source code is licensed under the MIT-style license found in the
+ * LICENSE file.
+ */
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Device IDs are long strings - GUIDs on Windows - which we'd otherwise copy
+// and compare all over the place. Interning them gives each distinct ID a
+// small integer that's cheap to store and compare.
+//
+// Entries are never removed: the number of devices a machine has ever had is
+// small.
+using DeviceHandle = uint32_t;
+
+// The handle for the empty ID
+constexpr DeviceHandle NO_DEVICE = 0;
+
+// Thread-safe; doesn't allocate if the ID has been seen before
+DeviceHandle InternDeviceID(std::string_view id);
+// The returned reference is valid for the lifetime of the process
+const std::string& GetDeviceID(DeviceHandle);
@@ -0,0 +1,487 @@
+/* Copyright (c) 2018-present, Fred Emmott
+ *
+ * This source code is licensed under the MIT-style license found in the
+ * LICENSE file.
+ */
+
+#include "DeviceStateTable.h"
+
+#include <StreamDeckSDK/ESDLogger.h>
+
+#include <array>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+#include "audio_json.h"
+#include "DebugLog.h"
+
+#ifdef _WIN32
+#include <windows.h>
+// windows.h must be first
+#include <mmdeviceapi.h>
+#elif defined(__APPLE__)
+#include <CoreAudio/CoreAudio.h>
+#else
+#include <AudioDevices/AudioDeviceChanges.h>
+#endif
+
+using namespace FredEmmott::Audio;
+
+#ifdef _WIN32
+
+class DeviceStateTable::Listener final : public IMMNotificationClient {
+ public:
+  explicit Listener(DeviceStateTable* table) : mTable(table) {
+  }
+
+  ~Listener() {
+    if (mEnumerator) {
+      mEnumerator->UnregisterEndpointNotificationCallback(this);
+      mEnumerator->Release();
+    }
+  }
+
+  bool Register() {
+    const auto created = CoCreateInstance(
+      __uuidof(MMDeviceEnumerator),
+      nullptr,
+      CLSCTX_ALL,
+      IID_PPV_ARGS(&mEnumerator));
+    if (FAILED(created)) {
+      mEnumerator = nullptr;
+      return false;
+    }
+    return SUCCEEDED(mEnumerator->RegisterEndpointNotificationCallback(this));
+  }
+
+  // Owned by the DeviceStateTable, not reference-counted
+  ULONG STDMETHODCALLTYPE AddRef() override {
+    return 1;
+  }
+
+  ULONG STDMETHODCALLTYPE Release() override {
+    return 1;
+  }
+
+  HRESULT STDMETHODCALLTYPE QueryInterface(REFIID iid, void** ret) override {
+    if (iid == __uuidof(IUnknown) || iid == __uuidof(IMMNotificationClient)) {
+      *ret = static_cast<IMMNotificationClient*>(this);
+      return S_OK;
+    }
+    *ret = nullptr;
+    return E_NOINTERFACE;
+  }
+
+  HRESULT STDMETHODCALLTYPE
+  OnDeviceStateChanged(LPCWSTR id, DWORD newState) override {
+    mTable->Set(InternDeviceID(ToUTF8(id)), ConvertState(newState));
+    return S_OK;
+  }
+
+  HRESULT STDMETHODCALLTYPE OnDeviceAdded(LPCWSTR id) override {
+    // We're not told the state; probe on next use
+    mTable->Forget(InternDeviceID(ToUTF8(id)));
+    return S_OK;
+  }
+
+  HRESULT STDMETHODCALLTYPE OnDeviceRemoved(LPCWSTR id) override {
+    mTable->Set(
+      InternDeviceID(ToUTF8(id)), AudioDeviceState::DEVICE_NOT_PRESENT);
+    return S_OK;
+  }
+
+  HRESULT STDMETHODCALLTYPE
+  OnDefaultDeviceChanged(EDataFlow, ERole, LPCWSTR) override {
+    // Handled by AudioDeviceLib
+    return S_OK;
+  }
+
+  HRESULT STDMETHODCALLTYPE
+  OnPropertyValueChanged(LPCWSTR, const PROPERTYKEY) override {
+    return S_OK;
+  }
+
+ private:
+  DeviceStateTable* mTable;
+  IMMDeviceEnumerator* mEnumerator = nullptr;
+
+  // Same conversion as AudioDeviceLib uses for device IDs
+  static std::string ToUTF8(LPCWSTR in) {
+    const auto size
+      = WideCharToMultiByte(CP_UTF8, 0, in, -1, nullptr, 0, nullptr, nullptr);
+    if (size <= 1) {
+      return {};
+    }
+    std::string ret(size, '\0');
+    WideCharToMultiByte(CP_UTF8, 0, in, -1, ret.data(), size, nullptr, nullptr);
+    // Drop the trailing null
+    ret.resize(size - 1);
+    return ret;
+  }
+
+  static AudioDeviceState ConvertState(DWORD state) {
+    switch (state) {
+      case DEVICE_STATE_ACTIVE:
+        return AudioDeviceState::CONNECTED;
+      case DEVICE_STATE_DISABLED:
+        return AudioDeviceState::DEVICE_DISABLED;
+      case DEVICE_STATE_UNPLUGGED:
+        return AudioDeviceState::DEVICE_PRESENT_NO_CONNECTION;
+      case DEVICE_STATE_NOTPRESENT:
+      default:
+        return AudioDeviceState::DEVICE_NOT_PRESENT;
+    }
+  }
+};
+
+#elif defined(__APPLE__)
+
+// CoreAudio reports that the device list has changed, and changes to each
+// device's properties. Forget everything when the list changes; otherwise,
+// forget a device when one of the properties that decide whether it's
+// usable changes, and probe it again on next use.
+class DeviceStateTable::Listener final {
+ public:
+  explicit Listener(DeviceStateTable* table) : mTable(table) {
+  }
+
+  ~Listener() {
+    if (mRegistered) {
+      AudioObjectRemovePropertyListener(
+        kAudioObjectSystemObject, &DEVICES_ADDRESS, &OnDevicesChanged, this);
+    }
+    std::scoped_lock lock(mRegisterMutex);
+    RemoveDeviceListeners();
+  }
+
+  bool Register() {
+    mRegistered = AudioObjectAddPropertyListener(
+                    kAudioObjectSystemObject,
+                    &DEVICES_ADDRESS,
+                    &OnDevicesChanged,
+                    this)
+      == noErr;
+    if (mRegistered) {
+      RegisterDevices();
+    }
+    return mRegistered;
+  }
+
+ private:
+  // kAudioObjectPropertyElementMain, which older SDKs call ...Master
+  static constexpr AudioObjectPropertyElement MAIN_ELEMENT = 0;
+
+  static constexpr AudioObjectPropertyAddress DEVICES_ADDRESS{
+    kAudioHardwarePropertyDevices,
+    kAudioObjectPropertyScopeGlobal,
+    MAIN_ELEMENT,
+  };
+
+  // A device being unplugged, or a jack or data source (e.g. built-in
+  // speakers vs headphones) changing
+  static constexpr std::array<AudioObjectPropertyAddress, 5> DEVICE_ADDRESSES{{
+    {kAudioDevicePropertyDeviceIsAlive,
+     kAudioObjectPropertyScopeGlobal,
+     MAIN_ELEMENT},
+    {kAudioDevicePropertyJackIsConnected,
+     kAudioDevicePropertyScopeOutput,
+     MAIN_ELEMENT},
+    {kAudioDevicePropertyJackIsConnected,
+     kAudioDevicePropertyScopeInput,
+     MAIN_ELEMENT},
+    {kAudioDevicePropertyDataSource,
+     kAudioDevicePropertyScopeOutput,
+     MAIN_ELEMENT},
+    {kAudioDevicePropertyDataSource,
+     kAudioDevicePropertyScopeInput,
+     MAIN_ELEMENT},
+  }};
+
+  DeviceStateTable* mTable;
+  bool mRegistered = false;
+
+  // Held while adding or removing device listeners
+  std::mutex mRegisterMutex;
+  // Held while reading or replacing mDevices; never held while calling
+  // CoreAudio, as removing a listener can wait for its callbacks to return
+  std::mutex mDevicesMutex;
+  // UIDs of the devices we're listening to, by object ID; a device that's
+  // gone can't be asked for its UID
+  std::unordered_map<AudioObjectID, std::string> mDevices;
+
+  // mRegisterMutex must be held
+  void RemoveDeviceListeners() {
+    decltype(mDevices) devices;
+    {
+      std::scoped_lock lock(mDevicesMutex);
+      devices.swap(mDevices);
+    }
+    for (const auto& [id, uid] : devices) {
+      for (const auto& address : DEVICE_ADDRESSES) {
+        // Fails harmlessly for properties the device doesn't have
+        AudioObjectRemovePropertyListener(id, &address, &OnDeviceChanged, this);
+      }
+    }
+  }
+
+  void RegisterDevices() {
+    std::scoped_lock lock(mRegisterMutex);
+    RemoveDeviceListeners();
+
+    UInt32 size = 0;
+    if (
+      AudioObjectGetPropertyDataSize(
+        kAudioObjectSystemObject, &DEVICES_ADDRESS, 0, nullptr, &size)
+      != noErr) {
+      return;
+    }
+    std::vector<AudioObjectID> ids(size / sizeof(AudioObjectID));
+    if (
+      AudioObjectGetPropertyData(
+        kAudioObjectSystemObject,
+        &DEVICES_ADDRESS,
+        0,
+        nullptr,
+        &size,
+        ids.data())
+      != noErr) {
+      return;
+    }
+    ids.resize(size / sizeof(AudioObjectID));
+
+    decltype(mDevices) devices;
+    for (const auto id : ids) {
+      auto uid = GetUID(id);
+      if (!uid.empty()) {
+        devices.emplace(id, std::move(uid));
+      }
+    }
+    {
+      // Before adding the listeners, so their callbacks can find the UIDs
+      std::scoped_lock devicesLock(mDevicesMutex);
+      mDevices = devices;
+    }
+    for (const auto& [id, uid] : devices) {
+      for (const auto& address : DEVICE_ADDRESSES) {
+        if (AudioObjectHasProperty(id, &address)) {
+          AudioObjectAddPropertyListener(id, &address, &OnDeviceChanged, this);
+        }
+      }
+    }
+  }
+
+  // Device IDs are UIDs; same conversion as AudioDeviceLib
+  static std::string GetUID(AudioObjectID device) {
+    static constexpr AudioObjectPropertyAddress address{
+      kAudioDevicePropertyDeviceUID,
+      kAudioObjectPropertyScopeGlobal,
+      MAIN_ELEMENT,
+    };
+    CFStringRef uid = nullptr;
+    UInt32 size = sizeof(uid);
+    if (
+      AudioObjectGetPropertyData(device, &address, 0, nullptr, &size, &uid)
+        != noErr
+      || !uid) {
+      return {};
+    }
+    const auto bufferSize = CFStringGetMaximumSizeForEncoding(
+                              CFStringGetLength(uid), kCFStringEncodingUTF8)
+      + 1;
+    std::string ret(bufferSize, '\0');
+    const auto converted = CFStringGetCString(
+      uid, ret.data(), bufferSize, kCFStringEncodingUTF8);
+    CFRelease(uid);
+    if (!converted) {
+      return {};
+    }
+    ret.resize(std::strlen(ret.c_str()));
+    return ret;
+  }
+
+  static OSStatus OnDevicesChanged(
+    AudioObjectID,
+    UInt32,
+    const AudioObjectPropertyAddress*,
+    void* data) {
+    auto listener = static_cast<Listener*>(data);
+    listener->mTable->Clear();
+    listener->RegisterDevices();
+    return noErr;
+  }
+
+  static OSStatus OnDeviceChanged(
+    AudioObjectID device,
+    UInt32,
+    const AudioObjectPropertyAddress*,
+    void* data) {
+    auto listener = static_cast<Listener*>(data);
+    std::string uid;
+    {
+      std::scoped_lock lock(listener->mDevicesMutex);
+      const auto it = listener->mDevices.find(device);
+      if (it == listener->mDevices.end()) {
+        return noErr;
+      }
+      uid = it->second;
+    }
+    listener->mTable->Forget(InternDeviceID(uid));
+    return noErr;
+  }
+};
+
+#else
+
+// The Linux backends report device changes themselves, with the new state;
+// see AudioDeviceChanges.h. The simulated backend doesn't, so every lookup
+// probes there.
+class DeviceStateTable::Listener final {
+ public:
+  explicit Listener(DeviceStateTable* table) : mTable(table) {
+  }
+
+  bool Register() {
+    mHandle = AddAudioDeviceChangeCallback(
+      [this](const std::string& id, AudioDeviceState state) {
+        if (id.empty()) {
+          mTable->Clear();
+          return;
+        }
+        mTable->Set(InternDeviceID(id), state);
+      });
+    return mHandle != nullptr;
+  }
+
+ private:
+  DeviceStateTable* mTable;
+  // Destroying this waits for any callback in progress
+  DeviceChangeCallbackHandle mHandle;
+};
+
+#endif
+
+DeviceStateTable::DeviceStateTable() = default;
+
+DeviceStateTable::~DeviceStateTable() {
+  // Stop notifications before the table is destroyed
+  mListener.reset();
+}
+
+bool DeviceStateTable::StartTracking() {
+  if (mListener) {
+    return mTracking;
+  }
+  mListener = std::make_unique<Listener>(this);
+  mTracking = mListener->Register();
+  return mTracking;
+}
+
+AudioDeviceState DeviceStateTable::Get(DeviceHandle device) {
+  uint64_t changeCount = 0;
+  if (mTracking) {
+    std::scoped_lock lock(mMutex);
+    if (device < mStates.size() && mStates[device]) {
+      return *mStates[device];
+    }
+    changeCount = mChangeCount;
+  }
+
+  const auto state = GetAudioDeviceState(GetDeviceID(device));
+  if (mTracking) {
+    std::scoped_lock lock(mMutex);
+    if (mChangeCount == changeCount) {
+      if (device >= mStates.size()) {
+        mStates.resize(device + 1);
+      }
+      mStates[device] = state;
+    }
+  }
+  return state;
+}
+
+size_t DeviceStateTable::CheckConsistency() {
+  if (!mTracking) {
+    return 0;
+  }
+
+  std::vector<std::pair<DeviceHandle, AudioDeviceState>> known;
+  uint64_t changeCount = 0;
+  {
+    std::scoped_lock lock(mMutex);
+    for (DeviceHandle device = 0; device < mStates.size(); ++device) {
+      if (mStates[device]) {
+        known.emplace_back(device, *mStates[device]);
+      }
+    }
+    changeCount = mChangeCount;
+  }
+
+  size_t mismatches = 0;
+  for (const auto& [device, state] : known) {
+    const auto& id = GetDeviceID(device);
+    const auto probed = GetAudioDeviceState(id);
+    if (probed == state) {
+      continue;
+    }
+
+    std::scoped_lock lock(mMutex);
+    if (mChangeCount != changeCount) {
+      // A notification arrived while we were probing; start again later
+      break;
+    }
+    ++mismatches;
+    ESDLog(
+      "Device state table has {} as {}, but it is {}",
+      id,
+      LogJSON{state},
+      LogJSON{probed});
+    mStates[device] = probed;
+  }
+  return mismatches;
+}
+
+void DeviceStateTable::SetChangeCallback(ChangeCallback callback) {
+  std::scoped_lock lock(mCallbackMutex);
+  mChangeCallback = std::move(callback);
+}
+
+void DeviceStateTable::NotifyChanged(DeviceHandle device) {
+  std::scoped_lock lock(mCallbackMutex);
+  if (mChangeCallback) {
+    mChangeCallback(device);
+  }
+}
+
+void DeviceStateTable::Set(DeviceHandle device, AudioDeviceState state) {
+  {
+    std::scoped_lock lock(mMutex);
+    ++mChangeCount;
+    if (device >= mStates.size()) {
+      mStates.resize(device + 1);
+    }
+    mStates[device] = state;
+  }
+  NotifyChanged(device);
+}
+
+void DeviceStateTable::Forget(DeviceHandle device) {
+  {
+    std::scoped_lock lock(mMutex);
+    ++mChangeCount;
+    if (device < mStates.size()) {
+      mStates[device].reset();
+    }
+  }
+  NotifyChanged(device);
+}
+
+void DeviceStateTable::Clear() {
+  {
+    std::scoped_lock lock(mMutex);
+    ++mChangeCount;
+    mStates.clear();
+  }
+  NotifyChanged(NO_DEVICE);
+}
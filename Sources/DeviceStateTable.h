@@ -0,0 +1,72 @@
+/* Copyright (c) 2018-present, Fred Emmott
+ *
+ * This source code is licensed under the MIT-style license found in the
+ * LICENSE file.
+ */
+#pragma once
+
+#include <AudioDevices/AudioDevices.h>
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+#include "DeviceIDTable.h"
+
+// Device states, kept up to date by OS notifications so that checking a
+// device on a key press doesn't need a round trip to the audio system.
+//
+// Each device is probed with GetAudioDeviceState() the first time it's
+// looked up, and after any notification that the table can't apply
+// directly; on platforms without notifications, every lookup probes.
+class DeviceStateTable {
+ public:
+  DeviceStateTable();
+  ~DeviceStateTable();
+
+  DeviceStateTable(const DeviceStateTable&) = delete;
+  DeviceStateTable& operator=(const DeviceStateTable&) = delete;
+
+  // Returns false if this platform doesn't report state changes. On
+  // Windows, COM must be initialized first.
+  bool StartTracking();
+
+  FredEmmott::Audio::AudioDeviceState Get(DeviceHandle);
+
+  // Called on the notification's thread after a notification changes the
+  // table, with the device that changed, or NO_DEVICE if any may have.
+  // Replacing the callback waits for any call in progress, so pass an empty
+  // function before destroying what it uses.
+  using ChangeCallback = std::function<void(DeviceHandle)>;
+  void SetChangeCallback(ChangeCallback);
+
+  // Probes every known device, logging and correcting any that are wrong.
+  // For debug builds: any mismatch is a missed notification.
+  size_t CheckConsistency();
+
+ private:
+  class Listener;
+
+  std::unique_ptr<Listener> mListener;
+  std::atomic<bool> mTracking{false};
+
+  std::mutex mMutex;
+  // Indexed by handle; empty if not known
+  std::vector<std::optional<FredEmmott::Audio::AudioDeviceState>> mStates;
+  // Bumped on every notification, so that a probe that raced with one
+  // doesn't overwrite it
+  uint64_t mChangeCount = 0;
+
+  // Held while calling mChangeCallback
+  std::mutex mCallbackMutex;
+  ChangeCallback mChangeCallback;
+
+  void NotifyChanged(DeviceHandle);
+  void Set(DeviceHandle, FredEmmott::Audio::AudioDeviceState);
+  void Forget(DeviceHandle);
+  void Clear();
+};
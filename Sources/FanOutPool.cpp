@@ -0,0 +1,83 @@
+/* Copyright (c) 2018-present, Fred Emmott
+ *
+ * This source code is licensed under the MIT-style license found in the
+ * LICENSE file.
+ */
+
+#include "FanOutPool.h"
+
+#ifdef _MSC_VER
+#include <objbase.h>
+#endif
+
+FanOutPool::FanOutPool(size_t threadCount) {
+  mThreads.reserve(threadCount);
+  for (size_t i = 0; i < threadCount; ++i) {
+    mThreads.emplace_back([this]() { RunWorker(); });
+  }
+}
+
+FanOutPool::~FanOutPool() {
+  {
+    std::scoped_lock lock(mMutex);
+    mStopping = true;
+  }
+  mWorkCV.notify_all();
+  for (auto& thread : mThreads) {
+    thread.join();
+  }
+}
+
+void FanOutPool::Run(const std::vector<std::function<void()>>& functions) {
+  if (functions.empty()) {
+    return;
+  }
+
+  std::scoped_lock runLock(mRunMutex);
+  std::unique_lock lock(mMutex);
+  mFunctions = &functions;
+  mNext = 0;
+  mPending = functions.size();
+  lock.unlock();
+  mWorkCV.notify_all();
+
+  lock.lock();
+  RunPending(lock);
+  mDoneCV.wait(lock, [this]() { return mPending == 0; });
+  mFunctions = nullptr;
+}
+
+void FanOutPool::RunPending(std::unique_lock<std::mutex>& lock) {
+  while (mFunctions && mNext < mFunctions->size()) {
+    const auto& function = (*mFunctions)[mNext++];
+    lock.unlock();
+    function();
+    lock.lock();
+    if (--mPending == 0) {
+      mDoneCV.notify_all();
+    }
+  }
+}
+
+void FanOutPool::RunWorker() {
+#ifdef _MSC_VER
+  CoInitializeEx(NULL, COINIT_MULTITHREADED);
+#endif
+
+  {
+    std::unique_lock lock(mMutex);
+    while (true) {
+      mWorkCV.wait(lock, [this]() {
+        return mStopping || (mFunctions && mNext < mFunctions->size());
+      });
+      if (mStopping) {
+        break;
+      }
+      RunPending(lock);
+    }
+  }
+
+#ifdef _MSC_VER
+  CoUninitialize();
+#endif
+}
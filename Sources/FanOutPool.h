@@ -0,0 +1,49 @@
+/* Copyright (c) 2018-present, Fred Emmott
+ *
+ * This source code is licensed under the MIT-style license found in the
+ * LICENSE file.
+ */
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Runs a few functions at once on threads that live as long as the pool, so
+// that switching several devices in one press doesn't start a thread for
+// each of them.
+class FanOutPool {
+ public:
+  // The calling thread also runs functions, so `threadCount` can be one
+  // less than the most functions that should run at once
+  explicit FanOutPool(size_t threadCount);
+  ~FanOutPool();
+
+  FanOutPool(const FanOutPool&) = delete;
+  FanOutPool& operator=(const FanOutPool&) = delete;
+
+  // Runs each function, and returns when they have all finished
+  void Run(const std::vector<std::function<void()>>&);
+
+ private:
+  // Serializes calls to Run()
+  std::mutex mRunMutex;
+
+  std::mutex mMutex;
+  std::condition_variable mWorkCV;
+  std::condition_variable mDoneCV;
+  const std::vector<std::function<void()>>* mFunctions = nullptr;
+  // The next function to start
+  size_t mNext = 0;
+  // Functions that haven't finished
+  size_t mPending = 0;
+  bool mStopping = false;
+  std::vector<std::thread> mThreads;
+
+  // Runs functions until there are none left to start
+  void RunPending(std::unique_lock<std::mutex>&);
+  void RunWorker();
+};
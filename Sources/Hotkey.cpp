@@ -0,0 +1,227 @@
+/* Copyright (c) 2018-present, Fred Emmott
+ *
+ * This source code is licensed under the MIT-style license found in the
+ * LICENSE file.
+ */
+
+#include "Hotkey.h"
+
+#include <cctype>
+#include <charconv>
+#include <string_view>
+
+#include "ButtonSettings.h"
+#include "DebugLog.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#elif defined(__APPLE__)
+#include <ApplicationServices/ApplicationServices.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// Windows virtual key codes; spelled out so that hotkeys can be compiled for
+// Windows on any platform
+constexpr uint16_t WIN_VK_TAB = 0x09;
+constexpr uint16_t WIN_VK_RETURN = 0x0D;
+constexpr uint16_t WIN_VK_SHIFT = 0x10;
+constexpr uint16_t WIN_VK_CONTROL = 0x11;
+constexpr uint16_t WIN_VK_MENU = 0x12;
+constexpr uint16_t WIN_VK_ESCAPE = 0x1B;
+constexpr uint16_t WIN_VK_SPACE = 0x20;
+constexpr uint16_t WIN_VK_LWIN = 0x5B;
+constexpr uint16_t WIN_VK_F1 = 0x70;
+
+bool IsAlphanumeric(char c) {
+  return (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9');
+}
+
+// 0 if `name` isn't 'F' followed by a number in [1, max]
+int ParseFunctionKey(std::string_view name, int max) {
+  if (name.size() < 2 || name.size() > 3 || name[0] != 'F') {
+    return 0;
+  }
+  int number = 0;
+  const auto end = name.data() + name.size();
+  const auto [ptr, ec] = std::from_chars(name.data() + 1, end, number);
+  if (ec != std::errc{} || ptr != end || number < 1 || number > max) {
+    return 0;
+  }
+  return number;
+}
+
+// 0 if not recognized
+uint16_t GetWindowsKeyCode(std::string_view name) {
+  if (name.size() == 1) {
+#ifdef _WIN32
+    const SHORT scanCode = VkKeyScanA(name[0]);
+    return scanCode == -1 ? 0 : LOBYTE(scanCode);
+#else
+    // What VkKeyScanA() gives for a US layout
+    const char key = static_cast<char>(
+      std::toupper(static_cast<unsigned char>(name[0])));
+    return IsAlphanumeric(key) ? key : 0;
+#endif
+  }
+
+  if (name[0] == 'F' && name.size() <= 3) {
+    const auto fKey = ParseFunctionKey(name, 24);
+    return fKey ? WIN_VK_F1 + (fKey - 1) : 0;
+  }
+  if (name == "SPACE") {
+    return WIN_VK_SPACE;
+  }
+  if (name == "ENTER" || name == "RETURN") {
+    return WIN_VK_RETURN;
+  }
+  if (name == "ESCAPE" || name == "ESC") {
+    return WIN_VK_ESCAPE;
+  }
+  if (name == "TAB") {
+    return WIN_VK_TAB;
+  }
+  // Other names are matched by their first letter or digit; ASCII values
+  // map directly to VK codes for A-Z and 0-9
+  return IsAlphanumeric(name[0]) ? name[0] : 0;
+}
+
+// 0 if not recognized
+uint16_t GetMacKeyCode(std::string_view name) {
+  if (name.size() == 1) {
+    const char key = name[0];
+    if (key >= 'A' && key <= 'Z') {
+      return 0x00 + (key - 'A');
+    }
+    return 0;
+  }
+
+  if (const auto fKey = ParseFunctionKey(name, 12)) {
+    static constexpr uint16_t fKeyCodes[12] = {
+      0x7A, 0x78, 0x63, 0x76, 0x60, 0x61, 0x62, 0x64, 0x65, 0x6D, 0x67, 0x6F};
+    return fKeyCodes[fKey - 1];
+  }
+  return 0;
+}
+
+void Append(CompiledHotkey& hotkey, const HotkeyEvent& event) {
+  hotkey.events[hotkey.eventCount++] = event;
+}
+
+}// namespace
+
+CompiledHotkey CompileHotkey(const HotkeyConfig& config, HotkeyKeyMap keyMap) {
+  if (!config.enabled || config.keyCode.empty()) {
+    return {};
+  }
+
+  CompiledHotkey ret;
+  if (keyMap == HotkeyKeyMap::MacOS) {
+    const auto keyCode = GetMacKeyCode(config.keyCode);
+    if (keyCode == 0) {
+      return {};
+    }
+    uint8_t modifiers = 0;
+    if (config.ctrl) {
+      modifiers |= HOTKEY_MODIFIER_CTRL;
+    }
+    if (config.alt) {
+      modifiers |= HOTKEY_MODIFIER_ALT;
+    }
+    if (config.shift) {
+      modifiers |= HOTKEY_MODIFIER_SHIFT;
+    }
+    if (config.win) {
+      modifiers |= HOTKEY_MODIFIER_WIN;
+    }
+    Append(ret, {keyCode, true, modifiers});
+    Append(ret, {keyCode, false, modifiers});
+    return ret;
+  }
+
+  const auto keyCode = GetWindowsKeyCode(config.keyCode);
+  if (keyCode == 0) {
+    return {};
+  }
+
+  uint16_t modifiers[4];
+  uint8_t modifierCount = 0;
+  if (config.ctrl) {
+    modifiers[modifierCount++] = WIN_VK_CONTROL;
+  }
+  if (config.alt) {
+    modifiers[modifierCount++] = WIN_VK_MENU;
+  }
+  if (config.shift) {
+    modifiers[modifierCount++] = WIN_VK_SHIFT;
+  }
+  if (config.win) {
+    modifiers[modifierCount++] = WIN_VK_LWIN;
+  }
+
+  for (uint8_t i = 0; i < modifierCount; ++i) {
+    Append(ret, {modifiers[i], true});
+  }
+  Append(ret, {keyCode, true});
+  Append(ret, {keyCode, false});
+  // Release modifiers in reverse order
+  for (uint8_t i = modifierCount; i > 0; --i) {
+    Append(ret, {modifiers[i - 1], false});
+  }
+  return ret;
+}
+
+void NativeHotkeySink::Send(const CompiledHotkey& hotkey) {
+  if (hotkey.IsEmpty()) {
+    return;
+  }
+
+#ifdef _WIN32
+  INPUT inputs[std::tuple_size_v<decltype(hotkey.events)>] = {};
+  for (uint8_t i = 0; i < hotkey.eventCount; ++i) {
+    const auto& event = hotkey.events[i];
+    inputs[i].type = INPUT_KEYBOARD;
+    inputs[i].ki.wVk = event.keyCode;
+    inputs[i].ki.dwFlags = event.keyDown ? 0 : KEYEVENTF_KEYUP;
+  }
+
+  const UINT result = SendInput(hotkey.eventCount, inputs, sizeof(INPUT));
+  if (result != hotkey.eventCount) {
+    DWORD errorCode = GetLastError();
+    PluginDebug("SendInput failed with error: {}", errorCode);
+  }
+#elif defined(__APPLE__)
+  CGEventSourceRef source
+    = CGEventSourceCreate(kCGEventSourceStateHIDSystemState);
+  for (uint8_t i = 0; i < hotkey.eventCount; ++i) {
+    const auto& event = hotkey.events[i];
+    if (i > 0) {
+      usleep(10000);// Small delay
+    }
+
+    CGEventFlags flags = 0;
+    if (event.modifiers & HOTKEY_MODIFIER_CTRL) {
+      flags |= kCGEventFlagMaskControl;
+    }
+    if (event.modifiers & HOTKEY_MODIFIER_ALT) {
+      flags |= kCGEventFlagMaskAlternate;
+    }
+    if (event.modifiers & HOTKEY_MODIFIER_SHIFT) {
+      flags |= kCGEventFlagMaskShift;
+    }
+    if (event.modifiers & HOTKEY_MODIFIER_WIN) {
+      flags |= kCGEventFlagMaskCommand;
+    }
+
+    CGEventRef cgEvent
+      = CGEventCreateKeyboardEvent(source, event.keyCode, event.keyDown);
+    CGEventSetFlags(cgEvent, flags);
+    CGEventPost(kCGHIDEventTap, cgEvent);
+    CFRelease(cgEvent);
+  }
+  CFRelease(source);
+#else
+  PluginDebug("Hotkeys are not supported on this platform");
+#endif
+}
@@ -0,0 +1,70 @@
+/* Copyright (c) 2018-present, Fred Emmott
+ *
+ * This source code is licensed under the MIT-style license found in the
+ * LICENSE file.
+ */
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+struct HotkeyConfig;
+
+// Which platform's key codes a hotkey is compiled to
+enum class HotkeyKeyMap {
+  Windows,
+  MacOS,
+};
+
+#ifdef __APPLE__
+constexpr HotkeyKeyMap NATIVE_HOTKEY_KEY_MAP = HotkeyKeyMap::MacOS;
+#else
+constexpr HotkeyKeyMap NATIVE_HOTKEY_KEY_MAP = HotkeyKeyMap::Windows;
+#endif
+
+enum HotkeyModifier : uint8_t {
+  HOTKEY_MODIFIER_CTRL = 1 << 0,
+  HOTKEY_MODIFIER_ALT = 1 << 1,
+  HOTKEY_MODIFIER_SHIFT = 1 << 2,
+  HOTKEY_MODIFIER_WIN = 1 << 3,
+};
+
+struct HotkeyEvent {
+  // VK_* on Windows, CGKeyCode on macOS
+  uint16_t keyCode = 0;
+  bool keyDown = false;
+  // HotkeyModifier flags to set on the event; only used on macOS, where
+  // modifiers are flags rather than separate key presses
+  uint8_t modifiers = 0;
+
+  bool operator==(const HotkeyEvent&) const = default;
+};
+
+// The key events for a hotkey, ready to send; built once when the settings
+// are parsed so that triggering it doesn't need to parse or allocate
+struct CompiledHotkey {
+  // Up to 4 modifiers and the key, each pressed and released
+  std::array<HotkeyEvent, 10> events{};
+  uint8_t eventCount = 0;
+
+  bool IsEmpty() const {
+    return eventCount == 0;
+  }
+};
+
+// Empty if the hotkey is disabled or the key isn't recognized
+CompiledHotkey CompileHotkey(
+  const HotkeyConfig&,
+  HotkeyKeyMap = NATIVE_HOTKEY_KEY_MAP);
+
+class HotkeySink {
+ public:
+  virtual ~HotkeySink() = default;
+  virtual void Send(const CompiledHotkey&) = 0;
+};
+
+// Sends the events to the OS; does nothing on other platforms
+class NativeHotkeySink final : public HotkeySink {
+ public:
+  void Send(const CompiledHotkey&) override;
+};
@@ -0,0 +1,98 @@
+/* Copyright (c) 2018-present, Fred Emmott
+ *
+ * This source code is licensed under the MIT-style license found in the
+ * LICENSE file.
+ */
+
+#include "HotkeyDispatcher.h"
+
+#include "DebugLog.h"
+#include "LatencyStats.h"
+
+using namespace FredEmmott::Audio;
+
+HotkeyDispatcher::HotkeyDispatcher(
+  std::unique_ptr<HotkeySink> sink,
+  LatencyStats& latencyStats)
+  : mSink(std::move(sink)), mLatencyStats(latencyStats) {
+  mThread = std::thread([this]() { Run(); });
+}
+
+HotkeyDispatcher::~HotkeyDispatcher() {
+  {
+    std::scoped_lock lock(mMutex);
+    mStopping = true;
+  }
+  mCV.notify_all();
+  mThread.join();
+}
+
+void HotkeyDispatcher::Enqueue(
+  const CompiledHotkey& hotkey,
+  std::optional<Confirmation> confirmation) {
+  if (hotkey.IsEmpty()) {
+    return;
+  }
+  {
+    std::scoped_lock lock(mMutex);
+    mEntries.push_back(
+      {hotkey, confirmation, false, std::chrono::steady_clock::now()});
+  }
+  mCV.notify_one();
+}
+
+void HotkeyDispatcher::OnDefaultDeviceChanged(
+  AudioDeviceDirection direction,
+  AudioDeviceRole role,
+  DeviceHandle device) {
+  bool confirmedAny = false;
+  {
+    std::scoped_lock lock(mMutex);
+    for (auto& entry : mEntries) {
+      const auto& confirmation = entry.confirmation;
+      if (
+        confirmation && confirmation->direction == direction
+        && confirmation->role == role && confirmation->device == device) {
+        entry.confirmed = true;
+        confirmedAny = true;
+      }
+    }
+  }
+  if (confirmedAny) {
+    mCV.notify_one();
+  }
+}
+
+void HotkeyDispatcher::Run() {
+  while (true) {
+    Entry entry;
+    {
+      std::unique_lock lock(mMutex);
+      mCV.wait(lock, [this]() { return mStopping || !mEntries.empty(); });
+      if (mEntries.empty()) {
+        // Only reachable when stopping; finish queued work first
+        break;
+      }
+
+      const auto& front = mEntries.front();
+      if (front.confirmation && !front.confirmed) {
+        const auto deadline = front.enqueuedAt + CONFIRMATION_TIMEOUT;
+        const auto confirmed = mCV.wait_until(lock, deadline, [this]() {
+          return mStopping || mEntries.front().confirmed;
+        });
+        if (!confirmed) {
+          PluginDebug("Default device change not confirmed, sending hotkey");
+        }
+      }
+
+      entry = std::move(mEntries.front());
+      mEntries.pop_front();
+    }
+
+    mLatencyStats.Record(
+      LatencyStage::HotkeyQueueWait,
+      std::chrono::steady_clock::now() - entry.enqueuedAt);
+    const auto timer = mLatencyStats.Measure(LatencyStage::TriggerHotkey);
+    mSink->Send(entry.hotkey);
+  }
+}
@@ -0,0 +1,71 @@
+/* Copyright (c) 2018-present, Fred Emmott
+ *
+ * This source code is licensed under the MIT-style license found in the
+ * LICENSE file.
+ */
+#pragma once
+
+#include <AudioDevices/AudioDevices.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+
+#include "DeviceIDTable.h"
+#include "Hotkey.h"
+
+class LatencyStats;
+
+// Sends hotkeys in order on a dedicated thread, so that the delays between
+// key events don't hold up audio switches or Stream Deck events.
+class HotkeyDispatcher {
+ public:
+  // A default device change to wait for before sending a hotkey
+  struct Confirmation {
+    FredEmmott::Audio::AudioDeviceDirection direction;
+    FredEmmott::Audio::AudioDeviceRole role;
+    DeviceHandle device = NO_DEVICE;
+  };
+
+  // If a change isn't confirmed within this, the hotkey is sent anyway
+  static constexpr std::chrono::milliseconds CONFIRMATION_TIMEOUT{1000};
+
+  HotkeyDispatcher(std::unique_ptr<HotkeySink>, LatencyStats&);
+  ~HotkeyDispatcher();
+
+  HotkeyDispatcher(const HotkeyDispatcher&) = delete;
+  HotkeyDispatcher& operator=(const HotkeyDispatcher&) = delete;
+
+  // Hotkeys queued after one that is waiting for confirmation wait behind
+  // it. To avoid missing the notification, queue a hotkey that waits before
+  // making the change.
+  void Enqueue(const CompiledHotkey&, std::optional<Confirmation> = {});
+
+  void OnDefaultDeviceChanged(
+    FredEmmott::Audio::AudioDeviceDirection,
+    FredEmmott::Audio::AudioDeviceRole,
+    DeviceHandle);
+
+ private:
+  struct Entry {
+    CompiledHotkey hotkey;
+    std::optional<Confirmation> confirmation;
+    bool confirmed = false;
+    std::chrono::steady_clock::time_point enqueuedAt;
+  };
+
+  std::unique_ptr<HotkeySink> mSink;
+  LatencyStats& mLatencyStats;
+
+  std::mutex mMutex;
+  std::condition_variable mCV;
+  std::deque<Entry> mEntries;
+  bool mStopping = false;
+  std::thread mThread;
+
+  void Run();
+};
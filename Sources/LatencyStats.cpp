@@ -0,0 +1,170 @@
+/* Copyright (c) 2018-present, Fred Emmott
+ *
+ * This source code is licensed under the MIT-style license found in the
+ * LICENSE file.
+ */
+
+#include "LatencyStats.h"
+
+#include <algorithm>
+#include <bit>
+
+std::string_view LatencyStageName(LatencyStage stage) {
+  switch (stage) {
+    case LatencyStage::KeyDownEvent:
+      return "keyDownEvent";
+    case LatencyStage::KeyUpEvent:
+      return "keyUpEvent";
+    case LatencyStage::WillAppearEvent:
+      return "willAppearEvent";
+    case LatencyStage::WillDisappearEvent:
+      return "willDisappearEvent";
+    case LatencyStage::SendToPluginEvent:
+      return "sendToPluginEvent";
+    case LatencyStage::SettingsParse:
+      return "settingsParse";
+    case LatencyStage::FillDeviceInfo:
+      return "fillDeviceInfo";
+    case LatencyStage::ResolveDevice:
+      return "resolveDevice";
+    case LatencyStage::SwitchQueueWait:
+      return "switchQueueWait";
+    case LatencyStage::GetDeviceState:
+      return "getDeviceState";
+    case LatencyStage::SetDefaultDevice:
+      return "setDefaultDevice";
+    case LatencyStage::TriggerHotkey:
+      return "triggerHotkey";
+    case LatencyStage::HotkeyQueueWait:
+      return "hotkeyQueueWait";
+    case LatencyStage::OutboundQueueWait:
+      return "outboundQueueWait";
+    case LatencyStage::DefaultChangeRoundTrip:
+      return "defaultChangeRoundTrip";
+    case LatencyStage::MultiSwitch:
+      return "multiSwitch";
+    case LatencyStage::StartupToFirstState:
+      return "startupToFirstState";
+    case LatencyStage::StartupToReconciled:
+      return "startupToReconciled";
+    case LatencyStage::KeyUpToSwitched:
+      return "keyUpToSwitched";
+  }
+  return "unknown";
+}
+
+size_t LatencyHistogram::GetBucketIndex(uint64_t value) {
+  if (value < LINEAR_BUCKETS) {
+    return value;
+  }
+  // value >= 16, so magnitude >= 4
+  const size_t magnitude = std::bit_width(value) - 1;
+  if (magnitude >= MAX_MAGNITUDE) {
+    return BUCKET_COUNT - 1;
+  }
+  const size_t subBucket = (value >> (magnitude - 3)) & (SUB_BUCKETS - 1);
+  return LINEAR_BUCKETS + ((magnitude - 4) * SUB_BUCKETS) + subBucket;
+}
+
+uint64_t LatencyHistogram::GetBucketUpperBound(size_t index) {
+  if (index < LINEAR_BUCKETS) {
+    return index;
+  }
+  const auto magnitude = 4 + ((index - LINEAR_BUCKETS) / SUB_BUCKETS);
+  const auto subBucket = (index - LINEAR_BUCKETS) % SUB_BUCKETS;
+  const uint64_t lowerBound = (SUB_BUCKETS + subBucket) << (magnitude - 3);
+  return lowerBound + (uint64_t{1} << (magnitude - 3)) - 1;
+}
+
+void LatencyHistogram::Record(std::chrono::microseconds duration) {
+  const uint64_t value = duration.count() < 0 ? 0 : duration.count();
+  mBuckets[GetBucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+  mCount.fetch_add(1, std::memory_order_relaxed);
+  mSum.fetch_add(value, std::memory_order_relaxed);
+
+  auto max = mMax.load(std::memory_order_relaxed);
+  while (value > max) {
+    if (mMax.compare_exchange_weak(max, value, std::memory_order_relaxed)) {
+      break;
+    }
+  }
+}
+
+uint64_t LatencyHistogram::GetCount() const {
+  return mCount.load(std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::GetMax() const {
+  return mMax.load(std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::GetMean() const {
+  const auto count = GetCount();
+  if (count == 0) {
+    return 0;
+  }
+  return mSum.load(std::memory_order_relaxed) / count;
+}
+
+uint64_t LatencyHistogram::GetValueAtPercentile(double percentile) const {
+  const auto count = GetCount();
+  if (count == 0) {
+    return 0;
+  }
+
+  const auto target = static_cast<uint64_t>((percentile / 100) * count);
+  uint64_t seen = 0;
+  for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+    seen += mBuckets[i].load(std::memory_order_relaxed);
+    if (seen > target || seen == count) {
+      return std::min(GetBucketUpperBound(i), GetMax());
+    }
+  }
+  return GetMax();
+}
+
+LatencyStats::ScopedTimer::ScopedTimer(LatencyStats* stats, LatencyStage stage)
+  : mStats(stats), mStage(stage), mStart(std::chrono::steady_clock::now()) {
+}
+
+LatencyStats::ScopedTimer::~ScopedTimer() {
+  mStats->Record(mStage, std::chrono::steady_clock::now() - mStart);
+}
+
+void LatencyStats::Record(
+  LatencyStage stage,
+  std::chrono::steady_clock::duration duration) {
+  mHistograms[static_cast<size_t>(stage)].Record(
+    std::chrono::duration_cast<std::chrono::microseconds>(duration));
+}
+
+LatencyStats::ScopedTimer LatencyStats::Measure(LatencyStage stage) {
+  return {this, stage};
+}
+
+nlohmann::json LatencyStats::ToJSON() const {
+  auto stages = nlohmann::json::object();
+  for (size_t i = 0; i < LATENCY_STAGE_COUNT; ++i) {
+    const auto& histogram = mHistograms[i];
+    if (histogram.GetCount() == 0) {
+      continue;
+    }
+    stages[std::string(LatencyStageName(static_cast<LatencyStage>(i)))] = {
+      {"count", histogram.GetCount()},
+      {"meanUs", histogram.GetMean()},
+      {"p50Us", histogram.GetValueAtPercentile(50)},
+      {"p90Us", histogram.GetValueAtPercentile(90)},
+      {"p99Us", histogram.GetValueAtPercentile(99)},
+      {"maxUs", histogram.GetMax()},
+    };
+  }
+
+  using std::chrono::duration_cast;
+  using std::chrono::milliseconds;
+  return {
+    {"elapsedMs",
+     duration_cast<milliseconds>(std::chrono::steady_clock::now() - mCreatedAt)
+       .count()},
+    {"stages", stages},
+  };
+}
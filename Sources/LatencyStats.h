@@ -0,0 +1,112 @@
+/* Copyright (c) 2018-present, Fred Emmott
+ *
+ * This source code is licensed under the MIT-style license found in the
+ * LICENSE file.
+ */
+#pragma once
+
+#include <nlohmann/json.hpp>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string_view>
+
+enum class LatencyStage {
+  // Whole Stream Deck event handlers
+  KeyDownEvent,
+  KeyUpEvent,
+  WillAppearEvent,
+  WillDisappearEvent,
+  SendToPluginEvent,
+  // Parts of the key-press-to-switch path
+  SettingsParse,
+  FillDeviceInfo,
+  ResolveDevice,
+  SwitchQueueWait,
+  GetDeviceState,
+  SetDefaultDevice,
+  TriggerHotkey,
+  // From queuing a hotkey until it is sent, including any wait for the
+  // switch to be confirmed
+  HotkeyQueueWait,
+  // From queuing a SetState, ShowAlert or SetSettings message until it is
+  // sent to Stream Deck
+  OutboundQueueWait,
+  // From SetDefaultAudioDeviceID() to the matching notification
+  DefaultChangeRoundTrip,
+  // All of the concurrent SetDefaultAudioDeviceID() calls for a multi-device
+  // switch
+  MultiSwitch,
+  // From plugin startup until the first button state is shown, and until
+  // live enumeration has replaced the device lists saved by the last run
+  StartupToFirstState,
+  StartupToReconciled,
+  // What the user perceives: from key-up until the switch has been made
+  KeyUpToSwitched,
+};
+constexpr size_t LATENCY_STAGE_COUNT
+  = static_cast<size_t>(LatencyStage::KeyUpToSwitched) + 1;
+
+std::string_view LatencyStageName(LatencyStage);
+
+// Log-linear histogram of microsecond values, in the style of HdrHistogram:
+// exact below 16us, then 8 buckets per power of two (<= 12.5% error).
+//
+// Recording is lock-free and allocation-free, so this is cheap enough to
+// leave enabled.
+class LatencyHistogram {
+ public:
+  void Record(std::chrono::microseconds);
+
+  uint64_t GetCount() const;
+  // Upper bound of the bucket containing the given percentile (0-100)
+  uint64_t GetValueAtPercentile(double percentile) const;
+  uint64_t GetMax() const;
+  uint64_t GetMean() const;
+
+ private:
+  static constexpr size_t LINEAR_BUCKETS = 16;
+  static constexpr size_t SUB_BUCKETS = 8;
+  static constexpr size_t MAX_MAGNITUDE = 40;
+  static constexpr size_t BUCKET_COUNT
+    = LINEAR_BUCKETS + ((MAX_MAGNITUDE - 4) * SUB_BUCKETS);
+
+  std::array<std::atomic<uint64_t>, BUCKET_COUNT> mBuckets{};
+  std::atomic<uint64_t> mCount{0};
+  std::atomic<uint64_t> mSum{0};
+  std::atomic<uint64_t> mMax{0};
+
+  static size_t GetBucketIndex(uint64_t value);
+  static uint64_t GetBucketUpperBound(size_t index);
+};
+
+class LatencyStats {
+ public:
+  class ScopedTimer {
+   public:
+    ScopedTimer(LatencyStats*, LatencyStage);
+    ~ScopedTimer();
+
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+   private:
+    LatencyStats* mStats;
+    LatencyStage mStage;
+    std::chrono::steady_clock::time_point mStart;
+  };
+
+  void Record(LatencyStage, std::chrono::steady_clock::duration);
+  [[nodiscard]] ScopedTimer Measure(LatencyStage);
+
+  // Includes the time since creation, so event rates can be derived from the
+  // counts
+  nlohmann::json ToJSON() const;
+
+ private:
+  const std::chrono::steady_clock::time_point mCreatedAt
+    = std::chrono::steady_clock::now();
+  std::array<LatencyHistogram, LATENCY_STAGE_COUNT> mHistograms;
+};
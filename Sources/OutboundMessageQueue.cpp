@@ -0,0 +1,198 @@
+/* Copyright (c) 2018-present, Fred Emmott
+ *
+ * This source code is licensed under the MIT-style license found in the
+ * LICENSE file.
+ */
+
+#include "OutboundMessageQueue.h"
+
+#include <StreamDeckSDK/ESDConnectionManager.h>
+
+#include <algorithm>
+
+#include "LatencyStats.h"
+
+ESDConnectionManagerSink::ESDConnectionManagerSink(
+  ESDConnectionManager* const& connectionManager)
+  : mConnectionManager(connectionManager) {
+}
+
+void ESDConnectionManagerSink::SetSettings(
+  const std::string& context,
+  const nlohmann::json& settings) {
+  mConnectionManager->SetSettings(settings, context);
+}
+
+void ESDConnectionManagerSink::SetState(const std::string& context, int state) {
+  mConnectionManager->SetState(state, context);
+}
+
+void ESDConnectionManagerSink::ShowAlert(const std::string& context) {
+  mConnectionManager->ShowAlertForContext(context);
+}
+
+bool OutboundMessageQueue::Entry::Push(MessageKind kind) {
+  const auto begin = order.begin();
+  const auto end = begin + count;
+  const auto it = std::find(begin, end, kind);
+  if (it == end) {
+    order[count++] = kind;
+    return false;
+  }
+  // Keep the others in order, and move this one to the end
+  std::rotate(it, it + 1, end);
+  return true;
+}
+
+OutboundMessageQueue::OutboundMessageQueue(
+  std::unique_ptr<OutboundMessageSink> sink,
+  LatencyStats& latencyStats)
+  : mSink(std::move(sink)), mLatencyStats(latencyStats) {
+  mWindowStart = mCreatedAt;
+  mThread = std::thread([this]() { Run(); });
+}
+
+OutboundMessageQueue::~OutboundMessageQueue() {
+  {
+    std::scoped_lock lock(mMutex);
+    mStopping = true;
+  }
+  mCV.notify_all();
+  mThread.join();
+}
+
+OutboundMessageQueue::Entry& OutboundMessageQueue::GetPendingEntry(
+  const std::string& context) {
+  const auto [it, inserted] = mPendingIndex.try_emplace(context, mPendingCount);
+  if (!inserted) {
+    return mPending[it->second];
+  }
+
+  if (mPendingCount == mPending.size()) {
+    mPending.emplace_back();
+  }
+  auto& entry = mPending[mPendingCount++];
+  entry.context = context;
+  entry.count = 0;
+  entry.settings = nullptr;
+  entry.enqueuedAt = std::chrono::steady_clock::now();
+  return entry;
+}
+
+OutboundMessageQueue::Entry& OutboundMessageQueue::Push(
+  const std::string& context,
+  MessageKind kind) {
+  ++mQueuedMessages;
+  auto& entry = GetPendingEntry(context);
+  if (entry.Push(kind)) {
+    ++mMergedMessages;
+  } else {
+    ++mPendingMessages;
+  }
+  mMaxQueueDepth = std::max(mMaxQueueDepth, mPendingMessages);
+  return entry;
+}
+
+void OutboundMessageQueue::SetState(const std::string& context, int state) {
+  {
+    std::scoped_lock lock(mMutex);
+    Push(context, MessageKind::State).state = state;
+  }
+  mCV.notify_one();
+}
+
+void OutboundMessageQueue::ShowAlert(const std::string& context) {
+  {
+    std::scoped_lock lock(mMutex);
+    Push(context, MessageKind::Alert);
+  }
+  mCV.notify_one();
+}
+
+void OutboundMessageQueue::SetSettings(
+  const std::string& context,
+  const nlohmann::json& settings) {
+  {
+    std::scoped_lock lock(mMutex);
+    Push(context, MessageKind::Settings).settings = settings;
+  }
+  mCV.notify_one();
+}
+
+nlohmann::json OutboundMessageQueue::GetMetrics() const {
+  using std::chrono::duration_cast;
+  using std::chrono::milliseconds;
+
+  std::scoped_lock lock(mMutex);
+  return {
+    {"elapsedMs",
+     duration_cast<milliseconds>(std::chrono::steady_clock::now() - mCreatedAt)
+       .count()},
+    {"queueDepth", mPendingMessages},
+    {"maxQueueDepth", mMaxQueueDepth},
+    {"queued", mQueuedMessages},
+    {"merged", mMergedMessages},
+    {"sent", mSentMessages},
+    {"peakSentPerSecond", mPeakMessagesPerSecond},
+  };
+}
+
+void OutboundMessageQueue::Run() {
+  while (true) {
+    size_t count = 0;
+    {
+      std::unique_lock lock(mMutex);
+      mCV.wait(lock, [this]() { return mStopping || mPendingCount > 0; });
+      if (mPendingCount == 0) {
+        // Only reachable when stopping; finish queued work first
+        break;
+      }
+      // Anything queued while we're sending this batch can be merged into
+      // the next one
+      std::swap(mPending, mSending);
+      count = mPendingCount;
+      mPendingCount = 0;
+      mPendingMessages = 0;
+      mPendingIndex.clear();
+    }
+
+    uint64_t sent = 0;
+    for (size_t i = 0; i < count; ++i) {
+      const auto& entry = mSending[i];
+      mLatencyStats.Record(
+        LatencyStage::OutboundQueueWait,
+        std::chrono::steady_clock::now() - entry.enqueuedAt);
+      Send(entry);
+      sent += entry.count;
+    }
+    RecordSent(sent);
+  }
+}
+
+void OutboundMessageQueue::Send(const Entry& entry) {
+  for (uint8_t i = 0; i < entry.count; ++i) {
+    switch (entry.order[i]) {
+      case MessageKind::Settings:
+        mSink->SetSettings(entry.context, entry.settings);
+        break;
+      case MessageKind::State:
+        mSink->SetState(entry.context, entry.state);
+        break;
+      case MessageKind::Alert:
+        mSink->ShowAlert(entry.context);
+        break;
+    }
+  }
+}
+
+void OutboundMessageQueue::RecordSent(uint64_t count) {
+  const auto now = std::chrono::steady_clock::now();
+  std::scoped_lock lock(mMutex);
+  mSentMessages += count;
+  if (now - mWindowStart >= std::chrono::seconds(1)) {
+    mWindowStart = now;
+    mWindowMessages = 0;
+  }
+  mWindowMessages += count;
+  mPeakMessagesPerSecond = std::max(mPeakMessagesPerSecond, mWindowMessages);
+}
@@ -0,0 +1,142 @@
+/* Copyright (c) 2018-present, Fred Emmott
+ *
+ * This source code is licensed under the MIT-style license found in the
+ * LICENSE file.
+ */
+#pragma once
+
+#include <nlohmann/json.hpp>
+
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+class ESDConnectionManager;
+class LatencyStats;
+
+// Where OutboundMessageQueue's messages go
+class OutboundMessageSink {
+ public:
+  virtual ~OutboundMessageSink() = default;
+  virtual void SetSettings(
+    const std::string& context,
+    const nlohmann::json& settings)
+    = 0;
+  virtual void SetState(const std::string& context, int state) = 0;
+  virtual void ShowAlert(const std::string& context) = 0;
+};
+
+// Sends the messages to Stream Deck
+class ESDConnectionManagerSink final : public OutboundMessageSink {
+ public:
+  // Stream Deck sets the connection manager after the plugin is constructed,
+  // so this is read when sending rather than when constructing
+  explicit ESDConnectionManagerSink(ESDConnectionManager* const&);
+
+  void SetSettings(const std::string& context, const nlohmann::json& settings)
+    override;
+  void SetState(const std::string& context, int state) override;
+  void ShowAlert(const std::string& context) override;
+
+ private:
+  ESDConnectionManager* const& mConnectionManager;
+};
+
+// Sends SetState, ShowAlert and SetSettings messages to Stream Deck from a
+// single writer thread.
+//
+// Messages for a context that haven't been sent yet are merged: only the
+// latest state and settings are sent, and repeated alerts are sent once. This
+// keeps bursts - such as profile loads, or a device change updating every
+// button - down to one message of each kind per button.
+//
+// A context's messages are sent in the order they were queued, with a merged
+// message taking the place of the latest one; e.g. an alert then a state
+// then another alert are sent as the state then the alert.
+class OutboundMessageQueue {
+ public:
+  OutboundMessageQueue(std::unique_ptr<OutboundMessageSink>, LatencyStats&);
+  ~OutboundMessageQueue();
+
+  OutboundMessageQueue(const OutboundMessageQueue&) = delete;
+  OutboundMessageQueue& operator=(const OutboundMessageQueue&) = delete;
+
+  void SetState(const std::string& context, int state);
+  void ShowAlert(const std::string& context);
+  void SetSettings(const std::string& context, const nlohmann::json& settings);
+
+  // Queue depth and throughput
+  nlohmann::json GetMetrics() const;
+
+ private:
+  enum class MessageKind : uint8_t {
+    Settings,
+    State,
+    Alert,
+  };
+
+  // Everything waiting to be sent for one context
+  struct Entry {
+    std::string context;
+    // The kinds of message to send, in order; each is there at most once
+    std::array<MessageKind, 3> order;
+    uint8_t count = 0;
+    int state = 0;
+    nlohmann::json settings;
+    // When the oldest message merged into this was queued
+    std::chrono::steady_clock::time_point enqueuedAt;
+
+    // Adds `kind` after everything else; returns true if it was already
+    // there, i.e. the new message replaces an older one
+    bool Push(MessageKind kind);
+  };
+
+  std::unique_ptr<OutboundMessageSink> mSink;
+  LatencyStats& mLatencyStats;
+
+  mutable std::mutex mMutex;
+  std::condition_variable mCV;
+  // Swapped with mSending on each flush, so neither the vectors nor the
+  // entries' strings need reallocating once they've grown to fit a profile
+  std::vector<Entry> mPending;
+  // Entries in use; later ones are only kept for their storage
+  size_t mPendingCount = 0;
+  // Messages in those entries
+  size_t mPendingMessages = 0;
+  // Index into mPending by context
+  std::unordered_map<std::string, size_t> mPendingIndex;
+  bool mStopping = false;
+  // Only used by the writer thread
+  std::vector<Entry> mSending;
+
+  // Guarded by mMutex
+  uint64_t mQueuedMessages = 0;
+  uint64_t mMergedMessages = 0;
+  uint64_t mSentMessages = 0;
+  size_t mMaxQueueDepth = 0;
+  // Messages sent in the current and busiest one-second windows
+  std::chrono::steady_clock::time_point mWindowStart;
+  uint64_t mWindowMessages = 0;
+  uint64_t mPeakMessagesPerSecond = 0;
+  const std::chrono::steady_clock::time_point mCreatedAt
+    = std::chrono::steady_clock::now();
+
+  std::thread mThread;
+
+  // Returns the entry for the context, adding one if needed; mMutex must be
+  // held
+  Entry& GetPendingEntry(const std::string& context);
+  // Adds a message of this kind for the context, and returns its entry so
+  // that the caller can set its value; mMutex must be held
+  Entry& Push(const std::string& context, MessageKind);
+  void Run();
+  void Send(const Entry&);
+  void RecordSent(uint64_t count);
+};
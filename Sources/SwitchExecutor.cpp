@@ -0,0 +1,75 @@
+/* Copyright (c) 2018-present, Fred Emmott
+ *
+ * This source code is licensed under the MIT-style license found in the
+ * LICENSE file.
+ */
+
+#include "SwitchExecutor.h"
+
+#ifdef _MSC_VER
+#include <objbase.h>
+#endif
+
+#include "DebugLog.h"
+
+SwitchExecutor::SwitchExecutor() {
+  mThread = std::thread([this]() { Run(); });
+}
+
+SwitchExecutor::~SwitchExecutor() {
+  {
+    std::scoped_lock lock(mMutex);
+    mStopping = true;
+  }
+  mCV.notify_all();
+  mThread.join();
+}
+
+void SwitchExecutor::Enqueue(
+  std::string description,
+  std::function<void()> task) {
+  {
+    std::scoped_lock lock(mMutex);
+    mTasks.push_back(
+      {std::move(description),
+       std::move(task),
+       std::chrono::steady_clock::now()});
+  }
+  mCV.notify_one();
+}
+
+void SwitchExecutor::Run() {
+#ifdef _MSC_VER
+  CoInitializeEx(NULL, COINIT_MULTITHREADED);
+#endif
+
+  while (true) {
+    Task task;
+    {
+      std::unique_lock lock(mMutex);
+      mCV.wait(lock, [this]() { return mStopping || !mTasks.empty(); });
+      if (mTasks.empty()) {
+        // Only reachable when stopping; finish queued work first
+        break;
+      }
+      task = std::move(mTasks.front());
+      mTasks.pop_front();
+    }
+
+    const auto startedAt = std::chrono::steady_clock::now();
+    task.function();
+    const auto finishedAt = std::chrono::steady_clock::now();
+
+    using std::chrono::duration_cast;
+    using std::chrono::microseconds;
+    PluginDebug(
+      "{}: {}us queued, {}us running",
+      task.description,
+      duration_cast<microseconds>(startedAt - task.enqueuedAt).count(),
+      duration_cast<microseconds>(finishedAt - startedAt).count());
+  }
+
+#ifdef _MSC_VER
+  CoUninitialize();
+#endif
+}
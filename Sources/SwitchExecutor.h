@@ -0,0 +1,43 @@
+/* Copyright (c) 2018-present, Fred Emmott
+ *
+ * This source code is licensed under the MIT-style license found in the
+ * LICENSE file.
+ */
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Runs audio device operations in order on a dedicated thread, so that a
+// slow endpoint switch doesn't block the Stream Deck event thread.
+class SwitchExecutor {
+ public:
+  SwitchExecutor();
+  ~SwitchExecutor();
+
+  SwitchExecutor(const SwitchExecutor&) = delete;
+  SwitchExecutor& operator=(const SwitchExecutor&) = delete;
+
+  // `description` is only used for logging
+  void Enqueue(std::string description, std::function<void()> task);
+
+ private:
+  struct Task {
+    std::string description;
+    std::function<void()> function;
+    std::chrono::steady_clock::time_point enqueuedAt;
+  };
+
+  std::mutex mMutex;
+  std::condition_variable mCV;
+  std::deque<Task> mTasks;
+  bool mStopping = false;
+  std::thread mThread;
+
+  void Run();
+};
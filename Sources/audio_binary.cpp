@@ -0,0 +1,218 @@
+/* Copyright (c) 2018-present, Fred Emmott
+ *
+ * This source code is licensed under the MIT-style license found in the
+ * LICENSE file.
+ */
+#include "audio_binary.h"
+
+#include <AudioDevices/AudioDevices.h>
+
+namespace FredEmmott::Audio {
+
+namespace {
+
+// Explicit values rather than the enums' own, so that files stay readable
+// if the library's enums change
+enum class DirectionCode : uint8_t {
+  OUTPUT = 0,
+  INPUT = 1,
+};
+
+enum class RoleCode : uint8_t {
+  DEFAULT = 0,
+  COMMUNICATION = 1,
+};
+
+enum class StateCode : uint8_t {
+  CONNECTED = 0,
+  DEVICE_NOT_PRESENT = 1,
+  DEVICE_DISABLED = 2,
+  DEVICE_PRESENT_NO_CONNECTION = 3,
+};
+
+bool ReadByte(std::string_view& in, uint8_t& value) {
+  if (in.empty()) {
+    return false;
+  }
+  value = static_cast<uint8_t>(in.front());
+  in.remove_prefix(1);
+  return true;
+}
+
+}// namespace
+
+void AppendBinary(std::string& out, uint32_t value) {
+  // Little-endian, regardless of platform
+  for (int i = 0; i < 4; ++i) {
+    out.push_back(static_cast<char>((value >> (i * 8)) & 0xff));
+  }
+}
+
+bool ReadBinary(std::string_view& in, uint32_t& value) {
+  if (in.size() < 4) {
+    return false;
+  }
+  value = 0;
+  for (int i = 0; i < 4; ++i) {
+    value |= static_cast<uint32_t>(static_cast<uint8_t>(in[i])) << (i * 8);
+  }
+  in.remove_prefix(4);
+  return true;
+}
+
+void AppendBinary(std::string& out, std::string_view value) {
+  AppendBinary(out, static_cast<uint32_t>(value.size()));
+  out.append(value);
+}
+
+bool ReadBinary(std::string_view& in, std::string& value) {
+  uint32_t size;
+  if (!ReadBinary(in, size) || in.size() < size) {
+    return false;
+  }
+  value.assign(in.substr(0, size));
+  in.remove_prefix(size);
+  return true;
+}
+
+void AppendBinary(std::string& out, AudioDeviceDirection direction) {
+  switch (direction) {
+    case AudioDeviceDirection::OUTPUT:
+      out.push_back(static_cast<char>(DirectionCode::OUTPUT));
+      return;
+    case AudioDeviceDirection::INPUT:
+      out.push_back(static_cast<char>(DirectionCode::INPUT));
+      return;
+  }
+}
+
+bool ReadBinary(std::string_view& in, AudioDeviceDirection& direction) {
+  uint8_t code;
+  if (!ReadByte(in, code)) {
+    return false;
+  }
+  switch (static_cast<DirectionCode>(code)) {
+    case DirectionCode::OUTPUT:
+      direction = AudioDeviceDirection::OUTPUT;
+      return true;
+    case DirectionCode::INPUT:
+      direction = AudioDeviceDirection::INPUT;
+      return true;
+  }
+  return false;
+}
+
+void AppendBinary(std::string& out, AudioDeviceRole role) {
+  switch (role) {
+    case AudioDeviceRole::DEFAULT:
+      out.push_back(static_cast<char>(RoleCode::DEFAULT));
+      return;
+    case AudioDeviceRole::COMMUNICATION:
+      out.push_back(static_cast<char>(RoleCode::COMMUNICATION));
+      return;
+  }
+}
+
+bool ReadBinary(std::string_view& in, AudioDeviceRole& role) {
+  uint8_t code;
+  if (!ReadByte(in, code)) {
+    return false;
+  }
+  switch (static_cast<RoleCode>(code)) {
+    case RoleCode::DEFAULT:
+      role = AudioDeviceRole::DEFAULT;
+      return true;
+    case RoleCode::COMMUNICATION:
+      role = AudioDeviceRole::COMMUNICATION;
+      return true;
+  }
+  return false;
+}
+
+void AppendBinary(std::string& out, AudioDeviceState state) {
+  switch (state) {
+    case AudioDeviceState::CONNECTED:
+      out.push_back(static_cast<char>(StateCode::CONNECTED));
+      return;
+    case AudioDeviceState::DEVICE_NOT_PRESENT:
+      out.push_back(static_cast<char>(StateCode::DEVICE_NOT_PRESENT));
+      return;
+    case AudioDeviceState::DEVICE_DISABLED:
+      out.push_back(static_cast<char>(StateCode::DEVICE_DISABLED));
+      return;
+    case AudioDeviceState::DEVICE_PRESENT_NO_CONNECTION:
+      out.push_back(
+        static_cast<char>(StateCode::DEVICE_PRESENT_NO_CONNECTION));
+      return;
+  }
+}
+
+bool ReadBinary(std::string_view& in, AudioDeviceState& state) {
+  uint8_t code;
+  if (!ReadByte(in, code)) {
+    return false;
+  }
+  switch (static_cast<StateCode>(code)) {
+    case StateCode::CONNECTED:
+      state = AudioDeviceState::CONNECTED;
+      return true;
+    case StateCode::DEVICE_NOT_PRESENT:
+      state = AudioDeviceState::DEVICE_NOT_PRESENT;
+      return true;
+    case StateCode::DEVICE_DISABLED:
+      state = AudioDeviceState::DEVICE_DISABLED;
+      return true;
+    case StateCode::DEVICE_PRESENT_NO_CONNECTION:
+      state = AudioDeviceState::DEVICE_PRESENT_NO_CONNECTION;
+      return true;
+  }
+  return false;
+}
+
+void AppendBinary(std::string& out, const AudioDeviceInfo& device) {
+  AppendBinary(out, device.id);
+  AppendBinary(out, device.interfaceName);
+  AppendBinary(out, device.endpointName);
+  AppendBinary(out, device.displayName);
+  AppendBinary(out, device.direction);
+  AppendBinary(out, device.state);
+}
+
+bool ReadBinary(std::string_view& in, AudioDeviceInfo& device) {
+  return ReadBinary(in, device.id) && ReadBinary(in, device.interfaceName)
+    && ReadBinary(in, device.endpointName)
+    && ReadBinary(in, device.displayName) && ReadBinary(in, device.direction)
+    && ReadBinary(in, device.state);
+}
+
+void AppendBinary(
+  std::string& out,
+  const std::map<std::string, AudioDeviceInfo>& devices) {
+  AppendBinary(out, static_cast<uint32_t>(devices.size()));
+  for (const auto& [id, device] : devices) {
+    // The key is always the device's ID, so isn't stored separately
+    AppendBinary(out, device);
+  }
+}
+
+bool ReadBinary(
+  std::string_view& in,
+  std::map<std::string, AudioDeviceInfo>& devices) {
+  uint32_t count;
+  if (!ReadBinary(in, count)) {
+    return false;
+  }
+  devices.clear();
+  for (uint32_t i = 0; i < count; ++i) {
+    AudioDeviceInfo device;
+    if (!ReadBinary(in, device)) {
+      return false;
+    }
+    auto id = device.id;
+    // Sorted when written, so each one goes at the end
+    devices.emplace_hint(devices.end(), std::move(id), std::move(device));
+  }
+  return true;
+}
+
+}// namespace FredEmmott::Audio
@@ -0,0 +1,49 @@
+/* Copyright (c) 2018-present, Fred Emmott
+ *
+ * This source code is licensed under the MIT-style license found in the
+ * LICENSE file.
+ */
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <string_view>
+
+// Compact binary encoding for our own caches. Unlike audio_json, this
+// doesn't build a tree: values are appended straight to a caller-provided
+// buffer, which can be reused.
+//
+// Readers consume from the front of `in`, and return false - leaving the
+// output in an unspecified state - if the data is truncated or invalid.
+
+namespace FredEmmott::Audio {
+
+void AppendBinary(std::string& out, uint32_t);
+bool ReadBinary(std::string_view& in, uint32_t&);
+
+void AppendBinary(std::string& out, std::string_view);
+bool ReadBinary(std::string_view& in, std::string&);
+
+enum class AudioDeviceDirection;
+void AppendBinary(std::string& out, AudioDeviceDirection);
+bool ReadBinary(std::string_view& in, AudioDeviceDirection&);
+
+enum class AudioDeviceRole;
+void AppendBinary(std::string& out, AudioDeviceRole);
+bool ReadBinary(std::string_view& in, AudioDeviceRole&);
+
+enum class AudioDeviceState;
+void AppendBinary(std::string& out, AudioDeviceState);
+bool ReadBinary(std::string_view& in, AudioDeviceState&);
+
+struct AudioDeviceInfo;
+void AppendBinary(std::string& out, const AudioDeviceInfo&);
+bool ReadBinary(std::string_view& in, AudioDeviceInfo&);
+
+void AppendBinary(
+  std::string& out,
+  const std::map<std::string, AudioDeviceInfo>&);
+bool ReadBinary(std::string_view& in, std::map<std::string, AudioDeviceInfo>&);
+
+}// namespace FredEmmott::Audio
@@ -7,8 +7,52 @@
 
 #include <AudioDevices/AudioDevices.h>
 
+#include <algorithm>
+#include <string_view>
+
 namespace FredEmmott::Audio {
 
+namespace {
+
+// The strings the to_json() overloads below produce; the AppendJSON()
+// overloads must match them
+
+std::string_view ToString(AudioDeviceState state) {
+  switch (state) {
+    case AudioDeviceState::CONNECTED:
+      return "connected";
+    case AudioDeviceState::DEVICE_NOT_PRESENT:
+      return "device_not_present";
+    case AudioDeviceState::DEVICE_DISABLED:
+      return "device_disabled";
+    case AudioDeviceState::DEVICE_PRESENT_NO_CONNECTION:
+      return "device_present_no_connection";
+  }
+  return {};
+}
+
+std::string_view ToString(AudioDeviceDirection direction) {
+  switch (direction) {
+    case AudioDeviceDirection::OUTPUT:
+      return "output";
+    case AudioDeviceDirection::INPUT:
+      return "input";
+  }
+  return {};
+}
+
+std::string_view ToString(AudioDeviceRole role) {
+  switch (role) {
+    case AudioDeviceRole::COMMUNICATION:
+      return "communication";
+    case AudioDeviceRole::DEFAULT:
+      return "default";
+  }
+  return {};
+}
+
+}// namespace
+
 void from_json(const nlohmann::json& j, AudioDeviceState& state) {
   if (j == "connected") {
     state = AudioDeviceState::CONNECTED;
@@ -29,20 +73,7 @@ void from_json(const nlohmann::json& j, AudioDeviceState& state) {
 }
 
 void to_json(nlohmann::json& j, const AudioDeviceState& state) {
-  switch (state) {
-    case AudioDeviceState::CONNECTED:
-      j = "connected";
-      return;
-    case AudioDeviceState::DEVICE_NOT_PRESENT:
-      j = "device_not_present";
-      return;
-    case AudioDeviceState::DEVICE_DISABLED:
-      j = "device_disabled";
-      return;
-    case AudioDeviceState::DEVICE_PRESENT_NO_CONNECTION:
-      j = "device_present_no_connection";
-      return;
-  }
+  j = ToString(state);
 }
 
 void to_json(nlohmann::json& j, const AudioDeviceInfo& device) {
@@ -73,14 +104,7 @@ void from_json(const nlohmann::json& j, AudioDeviceDirection& d) {
 }
 
 void to_json(nlohmann::json& j, const AudioDeviceDirection& d) {
-  switch (d) {
-    case AudioDeviceDirection::OUTPUT:
-      j = "output";
-      return;
-    case AudioDeviceDirection::INPUT:
-      j = "input";
-      return;
-  }
+  j = ToString(d);
 }
 
 void from_json(const nlohmann::json& j, AudioDeviceRole& r) {
@@ -89,14 +113,100 @@ void from_json(const nlohmann::json& j, AudioDeviceRole& r) {
 }
 
 void to_json(nlohmann::json& j, const AudioDeviceRole& r) {
-  switch (r) {
-    case AudioDeviceRole::COMMUNICATION:
-      j = "communication";
-      return;
-    case AudioDeviceRole::DEFAULT:
-      j = "default";
-      return;
+  j = ToString(r);
+}
+
+void AppendJSON(std::string& out, std::string_view value) {
+  constexpr std::string_view HEX{"0123456789abcdef"};
+  out.push_back('"');
+  while (!value.empty()) {
+    // Copy everything up to the next character that needs escaping at once
+    const auto safe = std::ranges::find_if(value, [](const char c) {
+      return c == '"' || c == '\\' || static_cast<unsigned char>(c) < 0x20;
+    });
+    const auto safeSize = static_cast<size_t>(safe - value.begin());
+    out.append(value.substr(0, safeSize));
+    if (safeSize == value.size()) {
+      break;
+    }
+    const auto c = value[safeSize];
+    value.remove_prefix(safeSize + 1);
+    switch (c) {
+      case '"':
+        out.append("\\\"");
+        continue;
+      case '\\':
+        out.append("\\\\");
+        continue;
+      case '\b':
+        out.append("\\b");
+        continue;
+      case '\f':
+        out.append("\\f");
+        continue;
+      case '\n':
+        out.append("\\n");
+        continue;
+      case '\r':
+        out.append("\\r");
+        continue;
+      case '\t':
+        out.append("\\t");
+        continue;
+    }
+    // Lower-case hex, as dump() uses
+    const auto byte = static_cast<unsigned char>(c);
+    out.append("\\u00");
+    out.push_back(HEX[byte >> 4]);
+    out.push_back(HEX[byte & 0xf]);
+  }
+  out.push_back('"');
+}
+
+void AppendJSON(std::string& out, AudioDeviceState state) {
+  AppendJSON(out, ToString(state));
+}
+
+void AppendJSON(std::string& out, AudioDeviceDirection direction) {
+  AppendJSON(out, ToString(direction));
+}
+
+void AppendJSON(std::string& out, AudioDeviceRole role) {
+  AppendJSON(out, ToString(role));
+}
+
+void AppendJSON(std::string& out, const AudioDeviceInfo& device) {
+  // nlohmann::json objects are std::maps, so dump() sorts the keys
+  out.append(R"({"direction":)");
+  AppendJSON(out, device.direction);
+  out.append(R"(,"displayName":)");
+  AppendJSON(out, device.displayName);
+  out.append(R"(,"endpointName":)");
+  AppendJSON(out, device.endpointName);
+  out.append(R"(,"id":)");
+  AppendJSON(out, device.id);
+  out.append(R"(,"interfaceName":)");
+  AppendJSON(out, device.interfaceName);
+  out.append(R"(,"state":)");
+  AppendJSON(out, device.state);
+  out.push_back('}');
+}
+
+void AppendJSON(
+  std::string& out,
+  const std::map<std::string, AudioDeviceInfo>& devices) {
+  out.push_back('{');
+  bool first = true;
+  for (const auto& [id, device] : devices) {
+    if (!first) {
+      out.push_back(',');
+    }
+    first = false;
+    AppendJSON(out, id);
+    out.push_back(':');
+    AppendJSON(out, device);
   }
+  out.push_back('}');
 }
 
 }// namespace FredEmmott::Audio
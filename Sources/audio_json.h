@@ -7,6 +7,10 @@
 
 #include <nlohmann/json.hpp>
 
+#include <map>
+#include <string>
+#include <string_view>
+
 namespace FredEmmott::Audio {
 
 enum class AudioDeviceState;
@@ -25,4 +29,16 @@ enum class AudioDeviceRole;
 void from_json(const nlohmann::json&, AudioDeviceRole&);
 void to_json(nlohmann::json&, const AudioDeviceRole&);
 
+// Append the same text as nlohmann::json(value).dump(), without building a
+// tree, so that `out` can be reused. Unlike dump(), invalid UTF-8 is copied
+// as-is instead of throwing.
+void AppendJSON(std::string& out, std::string_view);
+void AppendJSON(std::string& out, AudioDeviceState);
+void AppendJSON(std::string& out, AudioDeviceDirection);
+void AppendJSON(std::string& out, AudioDeviceRole);
+void AppendJSON(std::string& out, const AudioDeviceInfo&);
+void AppendJSON(
+  std::string& out,
+  const std::map<std::string, AudioDeviceInfo>&);
+
 }// namespace FredEmmott::Audio
@@ -0,0 +1,130 @@
+/* Copyright (c) 2018-present, Fred Emmott
+ *
+ * This source code is licensed under the MIT-style license found in the
+ * LICENSE file.
+ */
+
+// The streaming JSON writer must produce exactly what nlohmann does, and
+// the binary codec must round-trip.
+
+#include <nlohmann/json.hpp>
+
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "audio_binary.h"
+#include "audio_json.h"
+#include "ButtonSettings.h"
+#include "TestUtils.h"
+
+using json = nlohmann::json;
+
+namespace {
+
+AudioDeviceInfo MakeDevice(std::string id, AudioDeviceDirection direction) {
+  return {
+    .id = id,
+    .interfaceName = "2- USB \"Audio\" \\ Device",
+    .endpointName = "Speakers\t\x01\x1f\x7f",
+    .displayName = "Lautsprecher (Gerät) \xf0\x9f\x94\x8a",
+    .direction = direction,
+    .state = AudioDeviceState::DEVICE_PRESENT_NO_CONNECTION,
+  };
+}
+
+ButtonSettings MakeSettings() {
+  ButtonSettings settings;
+  settings.direction = AudioDeviceDirection::OUTPUT;
+  settings.role = AudioDeviceRole::COMMUNICATION;
+  settings.primaryDevice = MakeDevice("primary", settings.direction);
+  settings.secondaryDevice = MakeDevice("secondary\n", settings.direction);
+  settings.matchStrategy = DeviceMatchStrategy::Fuzzy;
+  settings.primaryHotkey = {
+    .enabled = true,
+    .ctrl = true,
+    .win = true,
+    .keyCode = "KeyM",
+  };
+  settings.hotkeysWaitForSwitch = true;
+  settings.targets = {
+    {
+      .direction = AudioDeviceDirection::INPUT,
+      .role = AudioDeviceRole::DEFAULT,
+      .device = MakeDevice("target", AudioDeviceDirection::INPUT),
+    },
+  };
+  settings.cycleDevices = {
+    MakeDevice("a", settings.direction),
+    MakeDevice("b", settings.direction),
+  };
+  return settings;
+}
+
+template <class T>
+void CheckSameAsDump(const T& value) {
+  const auto expected = json(value).dump();
+  std::string actual{"prefix"};
+  AppendJSON(actual, value);
+  if (actual != "prefix" + expected) {
+    fmt::print(stderr, "Expected {}\nGot      {}\n", expected, actual);
+  }
+  CHECK(actual == "prefix" + expected);
+}
+
+void TestJSON() {
+  const auto device = MakeDevice("id", AudioDeviceDirection::INPUT);
+  CheckSameAsDump(device);
+  CheckSameAsDump(std::map<std::string, AudioDeviceInfo>{});
+  CheckSameAsDump(std::map<std::string, AudioDeviceInfo>{
+    {"a", MakeDevice("a", AudioDeviceDirection::OUTPUT)},
+    {"b", MakeDevice("b", AudioDeviceDirection::OUTPUT)},
+  });
+
+  auto settings = MakeSettings();
+  CheckSameAsDump(settings);
+  // The arrays are left out if empty
+  settings.targets.clear();
+  settings.cycleDevices.clear();
+  CheckSameAsDump(settings);
+  CheckSameAsDump(ButtonSettings{});
+}
+
+void TestBinary() {
+  const auto settings = MakeSettings();
+  std::string encoded;
+  AppendBinary(encoded, settings);
+
+  std::string_view in{encoded};
+  ButtonSettings decoded;
+  CHECK(ReadBinary(in, decoded));
+  CHECK(in.empty());
+  CHECK(json(decoded) == json(settings));
+  // Compiled again, rather than stored
+  CHECK(!decoded.primaryHotkey.compiled.IsEmpty());
+  CHECK(
+    decoded.primaryHotkey.compiled.events
+    == CompileHotkey(settings.primaryHotkey).events);
+  // As are the device handles
+  CHECK(decoded.primaryHandle == InternDeviceID("primary"));
+  CHECK(decoded.targets.front().deviceHandle == InternDeviceID("target"));
+  const std::vector expectedCycleHandles{
+    InternDeviceID("a"), InternDeviceID("b")};
+  CHECK(decoded.cycleHandles == expectedCycleHandles);
+
+  // Every truncation is rejected, rather than read past the end
+  for (size_t size = 0; size < encoded.size(); ++size) {
+    std::string_view truncated{encoded.data(), size};
+    ButtonSettings ignored;
+    CHECK(!ReadBinary(truncated, ignored));
+  }
+}
+
+}// namespace
+
+int main() {
+  TestJSON();
+  TestBinary();
+  return EXIT_SUCCESS;
+}
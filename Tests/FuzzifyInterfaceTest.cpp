@@ -0,0 +1,117 @@
+/* Copyright (c) 2018-present, Fred Emmott
+ *
+ * This source code is licensed under the MIT-style license found in the
+ * LICENSE file.
+ */
+
+#include <array>
+#include <regex>
+#include <string>
+#include <string_view>
+
+#include "AudioDeviceCache.h"
+#include "TestUtils.h"
+
+namespace {
+
+// What FuzzifyInterface() replaced
+std::string RegexFuzzifyInterface(const std::string& name) {
+  const std::regex pattern{"^([0-9]+- )?(.+)$"};
+  std::smatch captures;
+  if (!std::regex_match(name, captures, pattern)) {
+    return name;
+  }
+  return captures[2];
+}
+
+void CheckSameAsRegex(const std::string& name) {
+  const auto expected = RegexFuzzifyInterface(name);
+  const auto actual = FuzzifyInterface(name);
+  if (actual != expected) {
+    fmt::print(
+      stderr,
+      "FuzzifyInterface({:?}): expected {:?}, got {:?}\n",
+      name,
+      expected,
+      actual);
+  }
+  CHECK(actual == expected);
+}
+
+void TestExamples() {
+  CHECK(FuzzifyInterface("Foo") == "Foo");
+  CHECK(FuzzifyInterface("2- Foo") == "Foo");
+  CHECK(FuzzifyInterface("12- Foo") == "Foo");
+  // Only the first prefix
+  CHECK(FuzzifyInterface("1- 2- Foo") == "2- Foo");
+  // Nothing left after the prefix, so it's the name
+  CHECK(FuzzifyInterface("12- ") == "12- ");
+  CHECK(FuzzifyInterface("") == "");
+  CHECK(FuzzifyInterface("- Foo") == "- Foo");
+  CHECK(FuzzifyInterface("2-Foo") == "2-Foo");
+  CHECK(FuzzifyInterface("2- Foo\n") == "2- Foo\n");
+}
+
+void TestEdgeCasesMatchRegex() {
+  for (const auto name : {
+         "",
+         " ",
+         "-",
+         "- ",
+         "1",
+         "1-",
+         "1- ",
+         "12- ",
+         "1- 2- Foo",
+         "1-  Foo",
+         "01- Foo",
+         "a1- Foo",
+         "1- \n",
+         "1- Foo\r",
+         "\n",
+         "Foo\nBar",
+       }) {
+    CheckSameAsRegex(name);
+  }
+}
+
+// Every string up to a small length from characters that matter to the
+// pattern
+void TestExhaustivelyMatchesRegex() {
+  constexpr std::string_view alphabet{"019- a\n\r"};
+  constexpr size_t maxLength = 5;
+
+  std::string name;
+  std::array<size_t, maxLength> indices {};
+  for (size_t length = 0; length <= maxLength; ++length) {
+    indices.fill(0);
+    while (true) {
+      name.clear();
+      for (size_t i = 0; i < length; ++i) {
+        name.push_back(alphabet[indices[i]]);
+      }
+      CheckSameAsRegex(name);
+
+      // Next combination, like incrementing a base-N number
+      size_t i = 0;
+      for (; i < length; ++i) {
+        if (++indices[i] < alphabet.size()) {
+          break;
+        }
+        indices[i] = 0;
+      }
+      if (i == length) {
+        break;
+      }
+    }
+  }
+}
+
+}// namespace
+
+int main() {
+  TestExamples();
+  TestEdgeCasesMatchRegex();
+  TestExhaustivelyMatchesRegex();
+  return EXIT_SUCCESS;
+}
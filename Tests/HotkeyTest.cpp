@@ -0,0 +1,304 @@
+/* Copyright (c) 2018-present, Fred Emmott
+ *
+ * This source code is licensed under the MIT-style license found in the
+ * LICENSE file.
+ */
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "AllocationCounter.h"
+#include "ButtonSettings.h"
+#include "HotkeyDispatcher.h"
+#include "LatencyStats.h"
+#include "TestUtils.h"
+
+using namespace FredEmmott::Audio;
+using namespace std::chrono_literals;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+// Windows virtual key codes
+constexpr uint16_t VK_SHIFT = 0x10;
+constexpr uint16_t VK_CONTROL = 0x11;
+constexpr uint16_t VK_MENU = 0x12;
+constexpr uint16_t VK_SPACE = 0x20;
+constexpr uint16_t VK_LWIN = 0x5B;
+constexpr uint16_t VK_F13 = 0x7C;
+constexpr uint16_t VK_F24 = 0x87;
+
+// macOS CGKeyCodes
+constexpr uint16_t MAC_F1 = 0x7A;
+constexpr uint16_t MAC_F12 = 0x6F;
+
+// Short enough not to slow the tests down, but far longer than sending a
+// queued hotkey should take
+constexpr auto SEND_TIMEOUT = 500ms;
+// How long to wait when checking that nothing is sent; short enough that
+// checking twice doesn't reach the confirmation timeout
+constexpr auto NOT_SENT_TIMEOUT = 100ms;
+static_assert(
+  SEND_TIMEOUT + 2 * NOT_SENT_TIMEOUT < HotkeyDispatcher::CONFIRMATION_TIMEOUT);
+
+HotkeyConfig MakeConfig(std::string keyCode) {
+  HotkeyConfig config;
+  config.enabled = true;
+  config.keyCode = std::move(keyCode);
+  return config;
+}
+
+std::vector<HotkeyEvent> GetEvents(const CompiledHotkey& hotkey) {
+  return {hotkey.events.begin(), hotkey.events.begin() + hotkey.eventCount};
+}
+
+// Records what the dispatcher sends, and how many allocations its thread
+// had made by then
+class RecordingSink final : public HotkeySink {
+ public:
+  struct Sent {
+    uint16_t keyCode = 0;
+    uint64_t allocations = 0;
+  };
+
+  RecordingSink() {
+    // So that recording doesn't allocate
+    mSent.reserve(1024);
+  }
+
+  void Send(const CompiledHotkey& hotkey) override {
+    const auto allocations = GetThreadAllocationCount();
+    {
+      std::scoped_lock lock(mMutex);
+      mSent.push_back({hotkey.events[0].keyCode, allocations});
+    }
+    mCV.notify_all();
+  }
+
+  // Waits up to `timeout` for `count` hotkeys to have been sent
+  std::vector<Sent> WaitFor(
+    size_t count,
+    std::chrono::milliseconds timeout = SEND_TIMEOUT) {
+    std::unique_lock lock(mMutex);
+    mCV.wait_for(lock, timeout, [&]() { return mSent.size() >= count; });
+    return mSent;
+  }
+
+  std::vector<Sent> Get() {
+    std::scoped_lock lock(mMutex);
+    return mSent;
+  }
+
+ private:
+  std::mutex mMutex;
+  std::condition_variable mCV;
+  std::vector<Sent> mSent;
+};
+
+std::vector<uint16_t> GetKeyCodes(
+  const std::vector<RecordingSink::Sent>& sent) {
+  std::vector<uint16_t> ret;
+  for (const auto& hotkey : sent) {
+    ret.push_back(hotkey.keyCode);
+  }
+  return ret;
+}
+
+// A hotkey whose first event is `keyCode` being pressed
+CompiledHotkey MakeHotkey(uint16_t keyCode) {
+  CompiledHotkey hotkey;
+  hotkey.events[0] = {keyCode, true};
+  hotkey.events[1] = {keyCode, false};
+  hotkey.eventCount = 2;
+  return hotkey;
+}
+
+void TestCompileWindows() {
+  auto config = MakeConfig("F13");
+  config.ctrl = true;
+  config.shift = true;
+  // Modifiers are pressed in order, and released in reverse
+  CHECK(
+    GetEvents(CompileHotkey(config, HotkeyKeyMap::Windows))
+    == (std::vector<HotkeyEvent>{
+      {VK_CONTROL, true},
+      {VK_SHIFT, true},
+      {VK_F13, true},
+      {VK_F13, false},
+      {VK_SHIFT, false},
+      {VK_CONTROL, false},
+    }));
+
+  config = MakeConfig("Q");
+  config.ctrl = config.alt = config.shift = config.win = true;
+  const auto all = CompileHotkey(config, HotkeyKeyMap::Windows);
+  CHECK(all.eventCount == all.events.size());
+  CHECK(all.events[1] == (HotkeyEvent{VK_MENU, true}));
+  CHECK(all.events[3] == (HotkeyEvent{VK_LWIN, true}));
+  CHECK(all.events[4] == (HotkeyEvent{'Q', true}));
+  CHECK(all.events[6] == (HotkeyEvent{VK_LWIN, false}));
+  CHECK(all.events[9] == (HotkeyEvent{VK_CONTROL, false}));
+
+  const auto keyCode = [](const char* name) -> uint16_t {
+    const auto hotkey = CompileHotkey(MakeConfig(name), HotkeyKeyMap::Windows);
+    return hotkey.IsEmpty() ? 0 : hotkey.events[0].keyCode;
+  };
+  CHECK(keyCode("F24") == VK_F24);
+  CHECK(keyCode("SPACE") == VK_SPACE);
+  CHECK(keyCode("7") == '7');
+  CHECK(keyCode("F25") == 0);
+  CHECK(keyCode("F0") == 0);
+  CHECK(keyCode("Fx") == 0);
+  CHECK(keyCode("?") == 0);
+  CHECK(keyCode("") == 0);
+}
+
+void TestCompileMacOS() {
+  auto config = MakeConfig("F1");
+  config.ctrl = true;
+  config.win = true;
+  // Modifiers are flags on the key's events
+  const uint8_t modifiers = HOTKEY_MODIFIER_CTRL | HOTKEY_MODIFIER_WIN;
+  CHECK(
+    GetEvents(CompileHotkey(config, HotkeyKeyMap::MacOS))
+    == (std::vector<HotkeyEvent>{
+      {MAC_F1, true, modifiers},
+      {MAC_F1, false, modifiers},
+    }));
+
+  CHECK(
+    CompileHotkey(MakeConfig("F12"), HotkeyKeyMap::MacOS).events[0].keyCode
+    == MAC_F12);
+  CHECK(CompileHotkey(MakeConfig("F13"), HotkeyKeyMap::MacOS).IsEmpty());
+  CHECK(CompileHotkey(MakeConfig("SPACE"), HotkeyKeyMap::MacOS).IsEmpty());
+}
+
+void TestCompileDisabled() {
+  auto config = MakeConfig("F13");
+  config.enabled = false;
+  CHECK(CompileHotkey(config, HotkeyKeyMap::Windows).IsEmpty());
+  CHECK(CompileHotkey(config, HotkeyKeyMap::MacOS).IsEmpty());
+}
+
+// Compiled when the settings are parsed, including the old key names
+void TestCompiledFromJSON() {
+  const nlohmann::json json{
+    {"direction", "output"},
+    {"hotkey",
+     {
+       {"hotkeyEnabled", true},
+       {"hotkeyCtrl", true},
+       {"hotkeyKey", "F13"},
+     }},
+  };
+  const auto config = json.get<ButtonSettings>().primaryHotkey;
+  CHECK(!config.compiled.IsEmpty());
+  CHECK(GetEvents(config.compiled) == GetEvents(CompileHotkey(config)));
+}
+
+void TestDispatchInOrder() {
+  LatencyStats stats;
+  auto ownedSink = std::make_unique<RecordingSink>();
+  auto& sink = *ownedSink;
+  HotkeyDispatcher dispatcher(std::move(ownedSink), stats);
+  for (const uint16_t keyCode : {1, 2, 3}) {
+    dispatcher.Enqueue(MakeHotkey(keyCode));
+  }
+  // Empty hotkeys aren't sent
+  dispatcher.Enqueue({});
+  dispatcher.Enqueue(MakeHotkey(4));
+  CHECK(GetKeyCodes(sink.WaitFor(4)) == (std::vector<uint16_t>{1, 2, 3, 4}));
+}
+
+// A hotkey waiting for a default device change holds up the ones behind it
+void TestDispatchWaitsForConfirmation() {
+  LatencyStats stats;
+  auto ownedSink = std::make_unique<RecordingSink>();
+  auto& sink = *ownedSink;
+  HotkeyDispatcher dispatcher(std::move(ownedSink), stats);
+
+  const auto device = InternDeviceID("sim-speakers");
+  dispatcher.Enqueue(
+    MakeHotkey(1),
+    HotkeyDispatcher::Confirmation{
+      AudioDeviceDirection::OUTPUT, AudioDeviceRole::DEFAULT, device});
+  dispatcher.Enqueue(MakeHotkey(2));
+  CHECK(sink.WaitFor(1, NOT_SENT_TIMEOUT).empty());
+
+  // Not the change it's waiting for
+  dispatcher.OnDefaultDeviceChanged(
+    AudioDeviceDirection::OUTPUT, AudioDeviceRole::COMMUNICATION, device);
+  dispatcher.OnDefaultDeviceChanged(
+    AudioDeviceDirection::OUTPUT,
+    AudioDeviceRole::DEFAULT,
+    InternDeviceID("sim-headset-out"));
+  CHECK(sink.WaitFor(1, NOT_SENT_TIMEOUT).empty());
+
+  const auto confirmedAt = Clock::now();
+  dispatcher.OnDefaultDeviceChanged(
+    AudioDeviceDirection::OUTPUT, AudioDeviceRole::DEFAULT, device);
+  CHECK(GetKeyCodes(sink.WaitFor(2)) == (std::vector<uint16_t>{1, 2}));
+  CHECK(Clock::now() - confirmedAt < SEND_TIMEOUT);
+}
+
+void TestDispatchConfirmationTimeout() {
+  LatencyStats stats;
+  auto ownedSink = std::make_unique<RecordingSink>();
+  auto& sink = *ownedSink;
+  HotkeyDispatcher dispatcher(std::move(ownedSink), stats);
+
+  const auto enqueuedAt = Clock::now();
+  dispatcher.Enqueue(
+    MakeHotkey(1),
+    HotkeyDispatcher::Confirmation{
+      AudioDeviceDirection::OUTPUT,
+      AudioDeviceRole::DEFAULT,
+      InternDeviceID("sim-speakers")});
+
+  while (sink.Get().empty()) {
+    CHECK(
+      Clock::now() - enqueuedAt
+      < HotkeyDispatcher::CONFIRMATION_TIMEOUT + SEND_TIMEOUT);
+    sink.WaitFor(1);
+  }
+  CHECK(Clock::now() - enqueuedAt >= HotkeyDispatcher::CONFIRMATION_TIMEOUT);
+}
+
+// Triggering a compiled hotkey doesn't allocate
+void TestDispatchDoesNotAllocate() {
+  if constexpr (!ALLOCATION_COUNTING_ENABLED) {
+    return;
+  }
+
+  LatencyStats stats;
+  auto ownedSink = std::make_unique<RecordingSink>();
+  auto& sink = *ownedSink;
+  HotkeyDispatcher dispatcher(std::move(ownedSink), stats);
+  constexpr size_t COUNT = 100;
+  for (size_t i = 0; i < COUNT; ++i) {
+    dispatcher.Enqueue(MakeHotkey(static_cast<uint16_t>(i)));
+    // One at a time, so that each is sent from an empty queue
+    CHECK(sink.WaitFor(i + 1).size() == i + 1);
+  }
+  const auto sent = sink.Get();
+  // From the first send, so any one-off setup before it isn't counted
+  CHECK(sent.back().allocations == sent.front().allocations);
+}
+
+}// namespace
+
+int main() {
+  TestCompileWindows();
+  TestCompileMacOS();
+  TestCompileDisabled();
+  TestCompiledFromJSON();
+  TestDispatchInOrder();
+  TestDispatchWaitsForConfirmation();
+  TestDispatchConfirmationTimeout();
+  TestDispatchDoesNotAllocate();
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,175 @@
+/* Copyright (c) 2018-present, Fred Emmott
+ *
+ * This source code is licensed under the MIT-style license found in the
+ * LICENSE file.
+ */
+
+#include <nlohmann/json.hpp>
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "LatencyStats.h"
+#include "OutboundMessageQueue.h"
+#include "TestUtils.h"
+
+using namespace std::chrono_literals;
+
+namespace {
+
+// Far longer than sending a queued message should take
+constexpr auto SEND_TIMEOUT = 500ms;
+
+// Messages to this context block the writer thread until Release(), so
+// that everything queued meanwhile is merged into the next batch
+const std::string BLOCKING_CONTEXT{"blocking"};
+
+// Records what the queue sends, as "context:message" strings
+class RecordingSink final : public OutboundMessageSink {
+ public:
+  void SetSettings(const std::string& context, const nlohmann::json& settings)
+    override {
+    Record(context, "settings=" + settings.dump());
+  }
+
+  void SetState(const std::string& context, int state) override {
+    Record(context, "state=" + std::to_string(state));
+  }
+
+  void ShowAlert(const std::string& context) override {
+    Record(context, "alert");
+  }
+
+  void Release() {
+    {
+      std::scoped_lock lock(mMutex);
+      mReleased = true;
+    }
+    mCV.notify_all();
+  }
+
+  // Waits up to SEND_TIMEOUT for `count` messages to have been sent
+  std::vector<std::string> WaitFor(size_t count) {
+    std::unique_lock lock(mMutex);
+    mCV.wait_for(lock, SEND_TIMEOUT, [&]() { return mSent.size() >= count; });
+    return mSent;
+  }
+
+ private:
+  std::mutex mMutex;
+  std::condition_variable mCV;
+  bool mReleased = false;
+  std::vector<std::string> mSent;
+
+  void Record(const std::string& context, const std::string& message) {
+    std::unique_lock lock(mMutex);
+    mSent.push_back(context + ":" + message);
+    mCV.notify_all();
+    if (context == BLOCKING_CONTEXT) {
+      mCV.wait(lock, [this]() { return mReleased; });
+    }
+  }
+};
+
+// A queue whose writer thread is blocked, so that messages queued before
+// Release() are sent as one batch
+struct BlockedQueue {
+  LatencyStats stats;
+  RecordingSink* sink = nullptr;
+  std::unique_ptr<OutboundMessageQueue> queue;
+
+  BlockedQueue() {
+    auto ownedSink = std::make_unique<RecordingSink>();
+    sink = ownedSink.get();
+    queue = std::make_unique<OutboundMessageQueue>(std::move(ownedSink), stats);
+    queue->ShowAlert(BLOCKING_CONTEXT);
+    // Wait until the writer thread is blocked in the sink
+    CHECK(sink->WaitFor(1).size() == 1);
+  }
+
+  // The messages sent after the blocking one
+  std::vector<std::string> ReleaseAndWaitFor(size_t count) {
+    sink->Release();
+    auto sent = sink->WaitFor(count + 1);
+    sent.erase(sent.begin());
+    return sent;
+  }
+};
+
+// Only the latest state and settings are sent, and an alert only once
+void TestMerge() {
+  BlockedQueue blocked;
+  auto& queue = *blocked.queue;
+  queue.SetState("a", 0);
+  queue.SetSettings("a", {{"x", 1}});
+  queue.SetState("a", 1);
+  queue.ShowAlert("a");
+  queue.ShowAlert("a");
+  queue.SetSettings("a", {{"x", 2}});
+
+  CHECK(
+    blocked.ReleaseAndWaitFor(3)
+    == (std::vector<std::string>{
+      "a:state=1",
+      "a:alert",
+      R"(a:settings={"x":2})",
+    }));
+
+  const auto metrics = queue.GetMetrics();
+  // Including the blocking alert
+  CHECK(metrics.at("queued") == 7);
+  CHECK(metrics.at("merged") == 3);
+}
+
+// A merged message takes the latest one's place, so a state that replaces
+// one queued before an alert is sent after the alert
+void TestOrder() {
+  BlockedQueue blocked;
+  auto& queue = *blocked.queue;
+  queue.SetState("a", 1);
+  queue.ShowAlert("a");
+  queue.SetState("a", 0);
+
+  queue.ShowAlert("b");
+  queue.SetState("b", 1);
+
+  // Contexts are sent in the order they were first queued
+  CHECK(
+    blocked.ReleaseAndWaitFor(4)
+    == (std::vector<std::string>{
+      "a:alert",
+      "a:state=0",
+      "b:alert",
+      "b:state=1",
+    }));
+}
+
+// Messages aren't merged with ones that have already been sent
+void TestNoMergeAfterSending() {
+  BlockedQueue blocked;
+  auto& queue = *blocked.queue;
+  queue.SetState("a", 1);
+  CHECK(
+    blocked.ReleaseAndWaitFor(1) == (std::vector<std::string>{"a:state=1"}));
+
+  queue.SetState("a", 1);
+  queue.ShowAlert("a");
+  const auto sent = blocked.sink->WaitFor(4);
+  CHECK(
+    std::vector<std::string>(sent.begin() + 1, sent.end())
+    == (std::vector<std::string>{"a:state=1", "a:state=1", "a:alert"}));
+  CHECK(blocked.queue->GetMetrics().at("merged") == 0);
+}
+
+}// namespace
+
+int main() {
+  TestMerge();
+  TestOrder();
+  TestNoMergeAfterSending();
+  return EXIT_SUCCESS;
+}
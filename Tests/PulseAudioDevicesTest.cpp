@@ -0,0 +1,130 @@
+/* Copyright (c) 2018-present, Fred Emmott
+ *
+ * This source code is licensed under the MIT-style license found in the
+ * LICENSE file.
+ */
+
+// Runs against a real PulseAudio or PipeWire server, with at least two
+// sinks; e.g. the null sinks described in the README. Skipped if there's no
+// server, or too few sinks.
+
+#include <AudioDevices/AudioDeviceChanges.h>
+#include <AudioDevices/AudioDevices.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+
+#include "TestUtils.h"
+
+using namespace FredEmmott::Audio;
+using namespace std::chrono_literals;
+
+namespace {
+
+// CTest's SKIP_RETURN_CODE for this test
+constexpr int SKIP_RETURN_CODE = 77;
+
+// Generous, as a busy server may take a while to report the change
+constexpr auto NOTIFICATION_TIMEOUT = 5s;
+
+void TestDeviceLists() {
+  for (const auto direction :
+       {AudioDeviceDirection::OUTPUT, AudioDeviceDirection::INPUT}) {
+    const auto devices = GetAudioDeviceList(direction);
+    for (const auto& [id, device] : devices) {
+      CHECK(!id.empty());
+      CHECK(device.id == id);
+      CHECK(device.direction == direction);
+      CHECK(!device.displayName.empty());
+      CHECK(GetAudioDeviceState(id) == device.state);
+    }
+
+    const auto defaultID
+      = GetDefaultAudioDeviceID(direction, AudioDeviceRole::DEFAULT);
+    if (!defaultID.empty()) {
+      CHECK(devices.contains(defaultID));
+    }
+  }
+  CHECK(
+    GetAudioDeviceState("no-such-device")
+    == AudioDeviceState::DEVICE_NOT_PRESENT);
+  // Unlike the simulated backend, device changes are reported
+  const auto handle = AddAudioDeviceChangeCallback(
+    [](const std::string&, AudioDeviceState) {});
+  CHECK(handle != nullptr);
+}
+
+// Changing the default is reported through the event subscription, for
+// both roles, as PulseAudio only has one default
+void TestSetDefault(const std::string& original, const std::string& other) {
+  std::mutex mutex;
+  std::condition_variable cv;
+  bool sawDefault = false;
+  bool sawCommunication = false;
+  const auto handle = AddDefaultAudioDeviceChangeCallback(
+    [&](
+      AudioDeviceDirection direction,
+      AudioDeviceRole role,
+      const std::string& id) {
+      if (direction != AudioDeviceDirection::OUTPUT || id != other) {
+        return;
+      }
+      {
+        std::scoped_lock lock(mutex);
+        (role == AudioDeviceRole::DEFAULT ? sawDefault : sawCommunication)
+          = true;
+      }
+      cv.notify_all();
+    });
+
+  SetDefaultAudioDeviceID(
+    AudioDeviceDirection::OUTPUT, AudioDeviceRole::DEFAULT, other);
+  {
+    std::unique_lock lock(mutex);
+    CHECK(cv.wait_for(lock, NOTIFICATION_TIMEOUT, [&]() {
+      return sawDefault && sawCommunication;
+    }));
+  }
+  CHECK(
+    GetDefaultAudioDeviceID(
+      AudioDeviceDirection::OUTPUT, AudioDeviceRole::COMMUNICATION)
+    == other);
+
+  SetDefaultAudioDeviceID(
+    AudioDeviceDirection::OUTPUT, AudioDeviceRole::DEFAULT, original);
+  CHECK(
+    GetDefaultAudioDeviceID(
+      AudioDeviceDirection::OUTPUT, AudioDeviceRole::DEFAULT)
+    == original);
+}
+
+}// namespace
+
+int main() {
+  // The backend connects in the background; this waits for it
+  const auto original = GetDefaultAudioDeviceID(
+    AudioDeviceDirection::OUTPUT, AudioDeviceRole::DEFAULT);
+  if (original.empty()) {
+    fmt::print(stderr, "No PulseAudio server, or no default sink\n");
+    return SKIP_RETURN_CODE;
+  }
+
+  TestDeviceLists();
+
+  std::string other;
+  for (const auto& [id, device] :
+       GetAudioDeviceList(AudioDeviceDirection::OUTPUT)) {
+    if (id != original && device.state == AudioDeviceState::CONNECTED) {
+      other = id;
+      break;
+    }
+  }
+  if (other.empty()) {
+    fmt::print(stderr, "Only one sink; can't test changing the default\n");
+    return SKIP_RETURN_CODE;
+  }
+  TestSetDefault(original, other);
+  return EXIT_SUCCESS;
+}
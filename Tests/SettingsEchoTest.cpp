@@ -0,0 +1,154 @@
+/* Copyright (c) 2018-present, Fred Emmott
+ *
+ * This source code is licensed under the MIT-style license found in the
+ * LICENSE file.
+ */
+
+// When a button's settings only have device IDs, the plugin fills in the
+// rest and sends them back to Stream Deck, which echoes them back as
+// DidReceiveSettings. The echo mustn't be backfilled again, but a real
+// change must be.
+
+#include <nlohmann/json.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <condition_variable>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "AudioSwitcherStreamDeckPlugin.h"
+#include "OutboundMessageQueue.h"
+#include "TestUtils.h"
+
+using namespace std::chrono_literals;
+
+namespace {
+
+// Far longer than sending a queued message should take
+constexpr auto SEND_TIMEOUT = 500ms;
+// How long to wait when checking that nothing is sent
+constexpr auto NOT_SENT_TIMEOUT = 200ms;
+
+const std::string TOGGLE_ACTION{"com.fredemmott.audiooutputswitch.toggle"};
+const std::string CONTEXT{"context"};
+const std::string DEVICE{"device"};
+
+// Records the settings the plugin sends, and how many messages it sends
+class RecordingSink final : public OutboundMessageSink {
+ public:
+  void SetSettings(const std::string&, const nlohmann::json& settings)
+    override {
+    std::scoped_lock lock(mMutex);
+    mSettings.push_back(settings);
+    ++mMessageCount;
+    mCV.notify_all();
+  }
+
+  void SetState(const std::string&, int) override {
+    std::scoped_lock lock(mMutex);
+    ++mMessageCount;
+    mCV.notify_all();
+  }
+
+  void ShowAlert(const std::string&) override {
+    std::scoped_lock lock(mMutex);
+    ++mMessageCount;
+    mCV.notify_all();
+  }
+
+  // Waits up to `timeout` for `count` SetSettings messages
+  std::vector<nlohmann::json> WaitForSettings(
+    size_t count,
+    std::chrono::milliseconds timeout = SEND_TIMEOUT) {
+    std::unique_lock lock(mMutex);
+    mCV.wait_for(lock, timeout, [&]() { return mSettings.size() >= count; });
+    return mSettings;
+  }
+
+  // Waits up to `timeout` for `count` messages of any kind
+  size_t WaitForMessages(size_t count, std::chrono::milliseconds timeout) {
+    std::unique_lock lock(mMutex);
+    mCV.wait_for(lock, timeout, [&]() { return mMessageCount >= count; });
+    return mMessageCount;
+  }
+
+ private:
+  std::mutex mMutex;
+  std::condition_variable mCV;
+  std::vector<nlohmann::json> mSettings;
+  size_t mMessageCount = 0;
+};
+
+nlohmann::json MakeSettings(const std::string& primary) {
+  return {
+    {"direction", "output"},
+    {"role", "default"},
+    {"primary", primary},
+    {"secondary", "sim-speakers"},
+  };
+}
+
+bool HasDisplayName(const nlohmann::json& device) {
+  return !device.at("displayName").get<std::string>().empty();
+}
+
+}// namespace
+
+int main() {
+  // The plugin saves the device lists in the working directory. Lists left
+  // by another test or benchmark have other devices, and would be used
+  // instead of the simulated ones until enumeration finishes.
+  std::filesystem::remove("deviceCache.bin");
+
+  auto ownedSink = std::make_unique<RecordingSink>();
+  auto& sink = *ownedSink;
+  AudioSwitcherStreamDeckPlugin plugin(std::move(ownedSink));
+
+  // Only the IDs, so the plugin fills in the names
+  plugin.WillAppearForAction(
+    TOGGLE_ACTION,
+    CONTEXT,
+    {{"settings", MakeSettings("sim-headset-out")}, {"state", 0}},
+    DEVICE);
+  const auto backfilled = sink.WaitForSettings(1);
+  CHECK(backfilled.size() == 1);
+  CHECK(backfilled[0].at("primary").at("id") == "sim-headset-out");
+  CHECK(HasDisplayName(backfilled[0].at("primary")));
+  CHECK(backfilled[0].at("secondary").at("id") == "sim-speakers");
+  // Let the button's state be sent, if it's going to be
+  const auto sentBeforeEcho = sink.WaitForMessages(SIZE_MAX, NOT_SENT_TIMEOUT);
+
+  // The echo of the backfill is ignored: nothing is backfilled again, and
+  // the button isn't redrawn
+  plugin.DidReceiveSettings(
+    TOGGLE_ACTION, CONTEXT, {{"settings", backfilled[0]}}, DEVICE);
+  CHECK(
+    sink.WaitForMessages(sentBeforeEcho + 1, NOT_SENT_TIMEOUT)
+    == sentBeforeEcho);
+
+  // A real change is backfilled
+  plugin.DidReceiveSettings(
+    TOGGLE_ACTION,
+    CONTEXT,
+    {{"settings", MakeSettings("sim-speakers")}},
+    DEVICE);
+  const auto changed = sink.WaitForSettings(2);
+  CHECK(changed.size() == 2);
+  CHECK(changed[1].at("primary").at("id") == "sim-speakers");
+  CHECK(HasDisplayName(changed[1].at("primary")));
+
+  // So is changing back, even though these settings were backfilled before
+  plugin.DidReceiveSettings(
+    TOGGLE_ACTION,
+    CONTEXT,
+    {{"settings", MakeSettings("sim-headset-out")}},
+    DEVICE);
+  const auto changedBack = sink.WaitForSettings(3);
+  CHECK(changedBack.size() == 3);
+  CHECK(changedBack[2] == backfilled[0]);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,109 @@
+/* Copyright (c) 2018-present, Fred Emmott
+ *
+ * This source code is licensed under the MIT-style license found in the
+ * LICENSE file.
+ */
+
+#include <AudioDevices/SimulatedAudioDevices.h>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "SwitchExecutor.h"
+#include "TestUtils.h"
+
+using namespace FredEmmott::Audio;
+using namespace std::chrono_literals;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+// Much slower than any real backend, so that timing noise doesn't matter
+constexpr auto BACKEND_LATENCY = 250ms;
+// Enqueueing should only take a lock and move a std::function
+constexpr auto MAX_ENQUEUE_TIME = BACKEND_LATENCY / 10;
+
+void SetOutput(const std::string& id) {
+  SetDefaultAudioDeviceID(
+    AudioDeviceDirection::OUTPUT, AudioDeviceRole::DEFAULT, id);
+}
+
+std::string GetOutput() {
+  return GetDefaultAudioDeviceID(
+    AudioDeviceDirection::OUTPUT, AudioDeviceRole::DEFAULT);
+}
+
+// Enqueueing returns before slow backend calls are made, and they're made in
+// order
+void TestEnqueueDoesNotWaitForBackend() {
+  SetOutput("sim-speakers");
+  Simulated::SetLatency(BACKEND_LATENCY);
+
+  std::mutex mutex;
+  std::vector<std::string> switched;
+  Clock::time_point enqueuedAt;
+  Clock::duration enqueueTime;
+  {
+    SwitchExecutor executor;
+    enqueuedAt = Clock::now();
+    for (const auto id :
+         {"sim-headset-out", "sim-speakers", "sim-headset-out"}) {
+      executor.Enqueue(id, [&mutex, &switched, id]() {
+        SetOutput(id);
+        std::scoped_lock lock(mutex);
+        switched.push_back(id);
+      });
+    }
+    enqueueTime = Clock::now() - enqueuedAt;
+
+    std::scoped_lock lock(mutex);
+    CHECK(switched.empty());
+  }
+  // The destructor finishes queued work
+  const auto finishedAt = Clock::now();
+
+  CHECK(enqueueTime < MAX_ENQUEUE_TIME);
+  CHECK(finishedAt - enqueuedAt >= 3 * BACKEND_LATENCY);
+  CHECK(
+    (switched
+     == std::vector<std::string>{
+       "sim-headset-out", "sim-speakers", "sim-headset-out"}));
+
+  Simulated::SetLatency({});
+  CHECK(GetOutput() == "sim-headset-out");
+}
+
+// A task that is blocked in the backend doesn't hold the queue lock, so the
+// event thread can keep queueing work
+void TestEnqueueWhileTaskIsRunning() {
+  Simulated::SetLatency(BACKEND_LATENCY);
+
+  SwitchExecutor executor;
+  std::atomic_bool started {false};
+  std::atomic_bool finished {false};
+  executor.Enqueue("slow switch", [&]() {
+    started = true;
+    SetOutput("sim-speakers");
+    finished = true;
+  });
+  while (!started) {
+    std::this_thread::yield();
+  }
+
+  const auto enqueuedAt = Clock::now();
+  executor.Enqueue("second switch", []() { SetOutput("sim-headset-out"); });
+  CHECK(Clock::now() - enqueuedAt < MAX_ENQUEUE_TIME);
+  CHECK(!finished);
+}
+
+}// namespace
+
+int main() {
+  TestEnqueueDoesNotWaitForBackend();
+  TestEnqueueWhileTaskIsRunning();
+  return EXIT_SUCCESS;
+}
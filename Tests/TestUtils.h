@@ -0,0 +1,22 @@
+/* Copyright (c) 2018-present, Fred Emmott
+ *
+ * This source code is licensed under the MIT-style license found in the
+ * LICENSE file.
+ */
+#pragma once
+
+#include <fmt/format.h>
+
+#include <cstdio>
+#include <cstdlib>
+
+// Prints the failed condition and exits, so that CTest reports the test as
+// failed
+#define CHECK(condition) \
+  do { \
+    if (!(condition)) { \
+      fmt::print( \
+        stderr, "{}:{}: CHECK({}) failed\n", __FILE__, __LINE__, #condition); \
+      std::exit(EXIT_FAILURE); \
+    } \
+  } while (0)
@@ -29,9 +29,37 @@
           "Image": "inactive"
         }
       ]
+    },
+    {
+      "SupportedInMultiActions": true,
+      "Icon": "active",
+      "Name": "Set Multiple Audio Devices",
+      "Tooltip": "Set input and output devices for several roles at once",
+      "UUID": "com.fredemmott.audiooutputswitch.multiset",
+      "States": [
+        {
+          "Image": "active"
+        },
+        {
+          "Image": "inactive"
+        }
+      ]
+    },
+    {
+      "SupportedInMultiActions": true,
+      "Icon": "speakers",
+      "Name": "Cycle Audio Devices",
+      "Tooltip": "Switch to the next connected device in a list",
+      "UUID": "com.fredemmott.audiooutputswitch.cycle",
+      "States": [
+        {
+          "Image": "speakers"
+        }
+      ]
     }
   ],
   "Author": "Fred Emmott",
+  "CodePathLin": "sdaudioswitch",
   "CodePathMac": "sdaudioswitch",
   "CodePathWin": "sdaudioswitch.exe",
   "Description": "Toggle or set the active audio devices.",
@@ -49,6 +77,9 @@
     {
       "Platform": "mac",
       "MinimumVersion": "${CMAKE_OSX_DEPLOYMENT_TARGET}"
+    },
+    {
+      "Platform": "linux"
     }
   ],
   "SDKVersion": 2,